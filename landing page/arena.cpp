@@ -0,0 +1,111 @@
+// Includes and namespaces
+#include "arena.h"
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+using namespace std;
+
+// Chunks kept across reset(), so one huge export doesn't pin its memory
+static const size_t kMaxRetained = 4 * 1024 * 1024;
+
+// Counters
+static ArenaStats stats;
+
+const ArenaStats& arenaStats() {
+    return stats;
+}
+
+// Arena
+Arena::Arena(size_t firstChunk) {
+    chunks_.push_back({static_cast<char*>(::operator new(firstChunk)), firstChunk});
+    stats.chunkAllocs++;
+}
+
+Arena::~Arena() {
+    for (auto& c : chunks_) ::operator delete(c.data);
+}
+
+void* Arena::do_allocate(size_t bytes, size_t alignment) {
+    while (true) {
+        Chunk& c = chunks_[current_];
+        uintptr_t base = reinterpret_cast<uintptr_t>(c.data);
+        size_t offset = ((base + used_ + alignment - 1) & ~(uintptr_t(alignment) - 1)) - base;
+        if (offset + bytes <= c.size) {
+            used_ = offset + bytes;
+            if (bytesUsed() > stats.peakBytes) stats.peakBytes = bytesUsed();
+            return c.data + offset;
+        }
+
+        // Move on to the next chunk, growing the arena if there is none
+        filledBefore_ += used_;
+        used_ = 0;
+        if (++current_ == chunks_.size()) {
+            size_t size = max(c.size * 2, bytes + alignment);
+            chunks_.push_back({static_cast<char*>(::operator new(size)), size});
+            stats.chunkAllocs++;
+        }
+    }
+}
+
+void Arena::reset() {
+    size_t total = 0;
+    for (auto& c : chunks_) total += c.size;
+    while (chunks_.size() > 1 && total > kMaxRetained) {
+        total -= chunks_.back().size;
+        ::operator delete(chunks_.back().data);
+        chunks_.pop_back();
+    }
+
+    current_ = 0;
+    used_ = 0;
+    filledBefore_ = 0;
+}
+
+// Arena pool
+unique_ptr<Arena> ArenaPool::acquire() {
+    stats.requests++;
+    if (free_.empty()) return make_unique<Arena>();
+    unique_ptr<Arena> arena = move(free_.back());
+    free_.pop_back();
+    return arena;
+}
+
+void ArenaPool::release(unique_ptr<Arena> arena) {
+    arena->reset();
+    free_.push_back(move(arena));
+}
+
+// Global allocation counter
+#ifdef DIARY_COUNT_ALLOCS
+static atomic<unsigned long long> heapAllocs{0};
+
+void* operator new(size_t size) {
+    heapAllocs++;
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+bool heapAllocCountEnabled() {
+    return true;
+}
+
+unsigned long long heapAllocCount() {
+    return heapAllocs;
+}
+#else
+bool heapAllocCountEnabled() {
+    return false;
+}
+
+unsigned long long heapAllocCount() {
+    return 0;
+}
+#endif
@@ -0,0 +1,86 @@
+// Include guard
+#ifndef ARENA_H
+#define ARENA_H
+
+// Include C++ standard libraries
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+// Bump-pointer arena. Frees nothing until reset(), and reset() keeps its
+// chunks, so a reused arena stops touching the heap once it has grown to
+// the size of a typical request.
+class Arena : public std::pmr::memory_resource {
+public:
+    explicit Arena(size_t firstChunk = 64 * 1024);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void reset();
+    size_t bytesUsed() const { return used_ + filledBefore_; }
+
+private:
+    struct Chunk {
+        char* data;
+        size_t size;
+    };
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    std::vector<Chunk> chunks_;
+    size_t current_ = 0;
+    size_t used_ = 0;
+    size_t filledBefore_ = 0;
+};
+
+// Arena-aware string for the request path
+using ArenaString = std::pmr::string;
+
+// Free list of arenas so steady-state requests reuse warm ones
+class ArenaPool {
+public:
+    std::unique_ptr<Arena> acquire();
+    void release(std::unique_ptr<Arena> arena);
+
+private:
+    std::vector<std::unique_ptr<Arena>> free_;
+};
+
+// Arena on loan from a pool, returned (and reset) on destruction
+class ArenaLease {
+public:
+    explicit ArenaLease(ArenaPool& pool) : pool_(&pool), arena_(pool.acquire()) {}
+    ArenaLease(ArenaLease&&) = default;
+    ArenaLease& operator=(ArenaLease&&) = default;
+    ~ArenaLease() { if (arena_) pool_->release(std::move(arena_)); }
+
+    Arena& operator*() const { return *arena_; }
+    Arena* get() const { return arena_.get(); }
+
+private:
+    ArenaPool* pool_;
+    std::unique_ptr<Arena> arena_;
+};
+
+// Allocation counters, reported on GET /stats (CPU workers fill connection arenas too, hence atomic)
+struct ArenaStats {
+    std::atomic<unsigned long> requests{0};     // arenas handed out
+    std::atomic<unsigned long> chunkAllocs{0};  // heap allocations made by arenas
+    std::atomic<size_t> peakBytes{0};           // largest single-arena footprint
+};
+
+const ArenaStats& arenaStats();
+
+// Process-wide operator new count; only tracked when built with DIARY_COUNT_ALLOCS
+bool heapAllocCountEnabled();
+unsigned long long heapAllocCount();
+
+// End include guard
+#endif
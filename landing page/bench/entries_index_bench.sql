@@ -0,0 +1,144 @@
+-- Index benchmark for the entries table
+--
+-- Builds 1,000,000 entries for 1,000 users in scratch tables that mirror the
+-- schema from createTables(). It runs the exact SELECTs from fetchEntries()
+-- and fetchEntriesByDate() with and without the secondary indexes, fetching
+-- every row, and prints the timing, fetch statistics and the plan the cursor
+-- actually used. The last block reports PASS/FAIL for the expected index
+-- range scans.
+--
+-- Run with SQL*Plus as the application user (needs the PLUSTRACE role and
+-- SELECT on V$SQL / V$SQL_PLAN, which system has):
+--   sqlplus system/Oracle@123@localhost:1521/orcl @bench/entries_index_bench.sql
+
+SET TIMING ON
+SET SERVEROUTPUT ON
+SET LINESIZE 200
+SET PAGESIZE 100
+SET FEEDBACK OFF
+
+-- Scratch tables
+BEGIN EXECUTE IMMEDIATE 'DROP TABLE bench_entries PURGE'; EXCEPTION WHEN OTHERS THEN NULL; END;
+/
+BEGIN EXECUTE IMMEDIATE 'DROP TABLE bench_users PURGE'; EXCEPTION WHEN OTHERS THEN NULL; END;
+/
+
+CREATE TABLE bench_users (
+    id NUMBER PRIMARY KEY,
+    username VARCHAR2(50) UNIQUE NOT NULL,
+    password VARCHAR2(100) NOT NULL
+);
+
+CREATE TABLE bench_entries (
+    id NUMBER GENERATED ALWAYS AS IDENTITY PRIMARY KEY,
+    user_id NUMBER NOT NULL,
+    title VARCHAR2(200),
+    entry_date DATE,
+    content CLOB,
+    created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    version NUMBER DEFAULT 1 NOT NULL,
+    FOREIGN KEY (user_id) REFERENCES bench_users(id)
+);
+
+INSERT INTO bench_users (id, username, password)
+SELECT LEVEL, 'user' || LEVEL, 'x' FROM dual CONNECT BY LEVEL <= 1000;
+
+-- 1,000 entries per user spread over about three years
+INSERT /*+ APPEND */ INTO bench_entries (user_id, title, entry_date, content, created_at)
+SELECT MOD(n, 1000) + 1,
+       'Entry ' || n,
+       DATE '2023-01-01' + MOD(n * 7, 1095),
+       'Dear diary, entry number ' || n || '.',
+       TIMESTAMP '2023-01-01 00:00:00' + NUMTODSINTERVAL(n * 90, 'SECOND')
+FROM (SELECT (a.n - 1) * 1000 + b.n AS n
+      FROM (SELECT LEVEL n FROM dual CONNECT BY LEVEL <= 1000) a,
+           (SELECT LEVEL n FROM dual CONNECT BY LEVEL <= 1000) b);
+COMMIT;
+
+EXEC DBMS_STATS.GATHER_TABLE_STATS(USER, 'BENCH_ENTRIES');
+
+-- Queries under test: user 42, full listing and March 2024, bound like the app
+VARIABLE uid NUMBER
+VARIABLE dfrom VARCHAR2(10)
+VARIABLE dto VARCHAR2(10)
+EXEC :uid := 42
+EXEC :dfrom := '2024-03-01'
+EXEC :dto := '2024-03-31'
+
+PROMPT
+PROMPT ===== Without secondary indexes =====
+
+SET AUTOTRACE TRACEONLY STATISTICS
+SELECT /*+ gather_plan_statistics */ /* bench_list_noix */ id, title, content,
+       TO_CHAR(entry_date, 'YYYY-MM-DD'),
+       TO_CHAR(created_at, 'YYYY-MM-DD HH24:MI:SS'), version
+FROM bench_entries WHERE user_id = :uid ORDER BY created_at DESC;
+
+SELECT /*+ gather_plan_statistics */ /* bench_range_noix */ id, title, content,
+       TO_CHAR(entry_date, 'YYYY-MM-DD'),
+       TO_CHAR(created_at, 'YYYY-MM-DD HH24:MI:SS'), version
+FROM bench_entries WHERE user_id = :uid
+AND entry_date >= TO_DATE(:dfrom, 'YYYY-MM-DD')
+AND entry_date < TO_DATE(:dto, 'YYYY-MM-DD') + 1
+ORDER BY entry_date DESC, created_at DESC;
+SET AUTOTRACE OFF
+
+SELECT p.plan_table_output
+FROM v$sql s,
+     TABLE(DBMS_XPLAN.DISPLAY_CURSOR(s.sql_id, s.child_number, 'ALLSTATS LAST')) p
+WHERE s.sql_text LIKE 'SELECT /*+ gather_plan_statistics */ /* bench\_%\_noix */%' ESCAPE '\'
+AND s.object_status = 'VALID';
+
+-- Same definitions as createTables()
+CREATE INDEX bench_entries_user_created_ix ON bench_entries (user_id, created_at DESC, id);
+CREATE INDEX bench_entries_user_date_ix ON bench_entries (user_id, entry_date);
+EXEC DBMS_STATS.GATHER_TABLE_STATS(USER, 'BENCH_ENTRIES', cascade => TRUE);
+
+PROMPT
+PROMPT ===== With secondary indexes =====
+
+SET AUTOTRACE TRACEONLY STATISTICS
+SELECT /*+ gather_plan_statistics */ /* bench_list_ix */ id, title, content,
+       TO_CHAR(entry_date, 'YYYY-MM-DD'),
+       TO_CHAR(created_at, 'YYYY-MM-DD HH24:MI:SS'), version
+FROM bench_entries WHERE user_id = :uid ORDER BY created_at DESC;
+
+SELECT /*+ gather_plan_statistics */ /* bench_range_ix */ id, title, content,
+       TO_CHAR(entry_date, 'YYYY-MM-DD'),
+       TO_CHAR(created_at, 'YYYY-MM-DD HH24:MI:SS'), version
+FROM bench_entries WHERE user_id = :uid
+AND entry_date >= TO_DATE(:dfrom, 'YYYY-MM-DD')
+AND entry_date < TO_DATE(:dto, 'YYYY-MM-DD') + 1
+ORDER BY entry_date DESC, created_at DESC;
+SET AUTOTRACE OFF
+
+SELECT p.plan_table_output
+FROM v$sql s,
+     TABLE(DBMS_XPLAN.DISPLAY_CURSOR(s.sql_id, s.child_number, 'ALLSTATS LAST')) p
+WHERE s.sql_text LIKE 'SELECT /*+ gather_plan_statistics */ /* bench\_%\_ix */%' ESCAPE '\'
+AND s.object_status = 'VALID';
+
+-- Check the indexed run used each index for a range scan
+DECLARE
+    hits NUMBER;
+BEGIN
+    FOR q IN (SELECT 'bench_list_ix' tag, 'BENCH_ENTRIES_USER_CREATED_IX' ix FROM dual
+              UNION ALL
+              SELECT 'bench_range_ix', 'BENCH_ENTRIES_USER_DATE_IX' FROM dual) LOOP
+        SELECT COUNT(*) INTO hits
+        FROM v$sql s JOIN v$sql_plan p
+          ON p.sql_id = s.sql_id AND p.child_number = s.child_number
+        WHERE s.sql_text LIKE 'SELECT /*+ gather_plan_statistics */ /* ' || q.tag || ' */%'
+        AND s.object_status = 'VALID'
+        AND p.operation = 'INDEX' AND p.options LIKE 'RANGE SCAN%'
+        AND p.object_name = q.ix;
+        DBMS_OUTPUT.PUT_LINE(q.tag || ': ' ||
+            CASE WHEN hits > 0 THEN 'PASS' ELSE 'FAIL' END ||
+            ' (INDEX RANGE SCAN on ' || q.ix || ')');
+    END LOOP;
+END;
+/
+
+-- Clean up
+DROP TABLE bench_entries PURGE;
+DROP TABLE bench_users PURGE;
@@ -0,0 +1,376 @@
+// Includes and namespaces
+#include "compress.h"
+#include <algorithm>
+#include <cctype>
+using namespace std;
+
+// Deflate constants
+static const size_t kWindowSize = 32768;
+static const size_t kBlockSize = 65536;
+static const int kMinMatch = 3;
+static const int kMaxMatch = 258;
+static const uint32_t kHashSize = 1 << 15;
+
+// Per-level search effort: how many chain links to follow, and when a match is long enough
+static const int kMaxChain[10] = {0, 4, 8, 16, 32, 64, 128, 256, 1024, 4096};
+static const int kNiceLength[10] = {0, 8, 16, 32, 64, 128, 128, 258, 258, 258};
+
+static const uint16_t kLengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                         35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                         3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t kDistBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                       257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                       8193, 12289, 16385, 24577};
+static const uint8_t kDistExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                       7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Lookup tables, built once
+struct Tables {
+    uint32_t crc[256];
+    uint16_t litCode[288];   // fixed Huffman codes, bit-reversed for LSB-first output
+    uint8_t litLength[288];
+    uint16_t distCode[30];
+    uint8_t lengthSymbol[kMaxMatch + 1];  // match length -> index into kLengthBase
+
+    Tables() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            crc[i] = c;
+        }
+
+        for (int sym = 0; sym < 288; ++sym) {
+            uint32_t code;
+            int len;
+            if (sym < 144) { code = 0x30 + sym; len = 8; }
+            else if (sym < 256) { code = 0x190 + (sym - 144); len = 9; }
+            else if (sym < 280) { code = sym - 256; len = 7; }
+            else { code = 0xC0 + (sym - 280); len = 8; }
+            litCode[sym] = static_cast<uint16_t>(reverse(code, len));
+            litLength[sym] = static_cast<uint8_t>(len);
+        }
+
+        for (int sym = 0; sym < 30; ++sym) {
+            distCode[sym] = static_cast<uint16_t>(reverse(sym, 5));
+        }
+
+        for (int len = kMinMatch, sym = 0; len <= kMaxMatch; ++len) {
+            while (sym < 28 && kLengthBase[sym + 1] <= len) ++sym;
+            lengthSymbol[len] = static_cast<uint8_t>(sym);
+        }
+    }
+
+    static uint32_t reverse(uint32_t code, int len) {
+        uint32_t r = 0;
+        for (int i = 0; i < len; ++i) r |= ((code >> i) & 1) << (len - 1 - i);
+        return r;
+    }
+};
+
+static const Tables& tables() {
+    static const Tables t;
+    return t;
+}
+
+static int distanceSymbol(size_t dist) {
+    int sym = 29;
+    while (kDistBase[sym] > dist) --sym;
+    return sym;
+}
+
+// Counters
+static CompressionStats stats;
+
+const CompressionStats& compressionStats() {
+    return stats;
+}
+
+// Compressor
+Compressor::Compressor(Encoding encoding, int level, pmr::string& out)
+    : encoding_(encoding), out_(out), window_(out.get_allocator()),
+      head_(kHashSize, 0, out.get_allocator()), prev_(kWindowSize, 0, out.get_allocator()) {
+    level = max(0, min(9, level));
+    maxChain_ = kMaxChain[level];
+    niceLength_ = kNiceLength[level];
+
+    if (encoding_ == Encoding::Gzip) {
+        // Magic, CM=deflate, no flags, no mtime, XFL=0, OS=unknown
+        static const char header[10] = {'\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, '\xff'};
+        out_.append(header, sizeof(header));
+        crc_ = 0xFFFFFFFFu;
+    } else {
+        // zlib header: deflate, 32 KB window, default level
+        out_ += '\x78';
+        out_ += '\x9c';
+    }
+}
+
+void Compressor::write(string_view data) {
+    const Tables& t = tables();
+    for (unsigned char c : data) {
+        if (encoding_ == Encoding::Gzip) {
+            crc_ = t.crc[(crc_ ^ c) & 0xFF] ^ (crc_ >> 8);
+        } else {
+            adlerA_ = (adlerA_ + c) % 65521;
+            adlerB_ = (adlerB_ + adlerA_) % 65521;
+        }
+    }
+    totalIn_ += data.size();
+
+    // Append in block-sized pieces so a large write still emits as it goes
+    while (!data.empty()) {
+        size_t room = kBlockSize - (window_.size() - pending_);
+        size_t take = min(room, data.size());
+        window_.append(data.data(), take);
+        data.remove_prefix(take);
+        if (window_.size() - pending_ == kBlockSize) compressPending(false);
+    }
+}
+
+void Compressor::finish() {
+    compressPending(true);
+    flushBits();
+
+    if (encoding_ == Encoding::Gzip) {
+        uint32_t crc = crc_ ^ 0xFFFFFFFFu;
+        uint32_t size = static_cast<uint32_t>(totalIn_);
+        for (int i = 0; i < 4; ++i) out_ += static_cast<char>((crc >> (8 * i)) & 0xFF);
+        for (int i = 0; i < 4; ++i) out_ += static_cast<char>((size >> (8 * i)) & 0xFF);
+    } else {
+        uint32_t adler = (adlerB_ << 16) | adlerA_;
+        for (int i = 3; i >= 0; --i) out_ += static_cast<char>((adler >> (8 * i)) & 0xFF);
+    }
+}
+
+void Compressor::compressPending(bool last) {
+    if (maxChain_ == 0) {
+        emitStored(pending_, window_.size(), last);
+    } else {
+        // Fall back to a stored block when the data doesn't compress (already-packed input)
+        size_t outSize = out_.size();
+        uint64_t bitBuf = bitBuf_;
+        int bitCount = bitCount_;
+        emitFixed(pending_, window_.size(), last);
+        if (out_.size() - outSize > window_.size() - pending_ + 5) {
+            out_.resize(outSize);
+            bitBuf_ = bitBuf;
+            bitCount_ = bitCount;
+            emitStored(pending_, window_.size(), last);
+        }
+    }
+    pending_ = window_.size();
+
+    // Keep only the history a match can reach
+    if (window_.size() > kWindowSize) {
+        size_t drop = window_.size() - kWindowSize;
+        window_.erase(0, drop);
+        base_ += drop;
+        pending_ -= drop;
+    }
+}
+
+void Compressor::emitStored(size_t start, size_t end, bool last) {
+    do {
+        size_t len = min<size_t>(end - start, 65535);
+        bool final = last && start + len == end;
+        putBits(final ? 1 : 0, 1);
+        putBits(0, 2);
+        flushBits();
+        out_ += static_cast<char>(len & 0xFF);
+        out_ += static_cast<char>(len >> 8);
+        out_ += static_cast<char>(~len & 0xFF);
+        out_ += static_cast<char>((~len >> 8) & 0xFF);
+        out_.append(window_, start, len);
+        start += len;
+    } while (start < end);
+}
+
+void Compressor::emitFixed(size_t start, size_t end, bool last) {
+    const Tables& t = tables();
+    const unsigned char* w = reinterpret_cast<const unsigned char*>(window_.data());
+
+    putBits(last ? 1 : 0, 1);
+    putBits(1, 2);
+
+    auto insert = [&](size_t i) -> uint32_t {
+        uint32_t h = ((w[i] << 10) ^ (w[i + 1] << 5) ^ w[i + 2]) & (kHashSize - 1);
+        uint32_t candidate = head_[h];
+        uint32_t pos = static_cast<uint32_t>(base_ + i);
+        head_[h] = pos + 1;
+        prev_[pos & (kWindowSize - 1)] = candidate;
+        return candidate;
+    };
+
+    size_t i = start;
+    while (i < end) {
+        int bestLen = 0;
+        size_t bestDist = 0;
+
+        if (i + kMinMatch <= end) {
+            uint32_t pos = static_cast<uint32_t>(base_ + i);
+            uint32_t link = insert(i);
+            int maxLen = static_cast<int>(min<size_t>(kMaxMatch, end - i));
+            for (int chain = maxChain_; link != 0 && chain > 0; --chain) {
+                uint32_t p = link - 1;
+                if (p < base_ || pos - p > kWindowSize) break;
+
+                const unsigned char* a = w + (p - base_);
+                const unsigned char* b = w + i;
+                int len = 0;
+                while (len < maxLen && a[len] == b[len]) ++len;
+                if (len > bestLen) {
+                    bestLen = len;
+                    bestDist = pos - p;
+                    if (len >= niceLength_) break;
+                }
+
+                link = prev_[p & (kWindowSize - 1)];
+                if (link - 1 >= p) break;  // slot reused by a newer position
+            }
+        }
+
+        if (bestLen >= kMinMatch) {
+            int ls = t.lengthSymbol[bestLen];
+            putCode(t.litCode[257 + ls], t.litLength[257 + ls]);
+            putBits(bestLen - kLengthBase[ls], kLengthExtra[ls]);
+            int ds = distanceSymbol(bestDist);
+            putCode(t.distCode[ds], 5);
+            putBits(static_cast<uint32_t>(bestDist - kDistBase[ds]), kDistExtra[ds]);
+
+            for (size_t k = i + 1; k < i + bestLen && k + kMinMatch <= end; ++k) insert(k);
+            i += bestLen;
+        } else {
+            putCode(t.litCode[w[i]], t.litLength[w[i]]);
+            ++i;
+        }
+    }
+
+    putCode(t.litCode[256], t.litLength[256]);
+}
+
+void Compressor::putBits(uint32_t value, int count) {
+    bitBuf_ |= static_cast<uint64_t>(value) << bitCount_;
+    bitCount_ += count;
+    while (bitCount_ >= 8) {
+        out_ += static_cast<char>(bitBuf_ & 0xFF);
+        bitBuf_ >>= 8;
+        bitCount_ -= 8;
+    }
+}
+
+void Compressor::putCode(uint32_t code, int length) {
+    putBits(code, length);
+}
+
+void Compressor::flushBits() {
+    if (bitCount_ > 0) out_ += static_cast<char>(bitBuf_ & 0xFF);
+    bitBuf_ = 0;
+    bitCount_ = 0;
+}
+
+// Encode a whole body
+BodyEncoder::BodyEncoder(Encoding encoding, int level, size_t expectedBytes, size_t minBytes,
+                         pmr::memory_resource* memory)
+    : body_{pmr::string(memory), Encoding::Identity} {
+    if (encoding == Encoding::Identity || expectedBytes < minBytes) {
+        if (encoding != Encoding::Identity) stats.skipped++;
+        body_.data.reserve(expectedBytes);
+    } else {
+        body_.data.reserve(expectedBytes / 2);
+        body_.encoding = encoding;
+        compressor_.emplace(encoding, level, body_.data);
+    }
+}
+
+void BodyEncoder::write(string_view data) {
+    rawBytes_ += data.size();
+    if (compressor_) {
+        compressor_->write(data);
+    } else {
+        body_.data.append(data.data(), data.size());
+    }
+}
+
+EncodedBody BodyEncoder::finish() {
+    if (compressor_) {
+        compressor_->finish();
+        compressor_.reset();
+        stats.compressed++;
+    }
+    stats.rawBytes += rawBytes_;
+    stats.sentBytes += body_.data.size();
+    return move(body_);
+}
+
+// Case-insensitive prefix test
+static bool startsWithNoCase(string_view text, string_view prefix) {
+    if (text.size() < prefix.size()) return false;
+    for (size_t i = 0; i < prefix.size(); ++i) {
+        if (tolower(static_cast<unsigned char>(text[i])) != prefix[i]) return false;
+    }
+    return true;
+}
+
+// Case-insensitive whole-token match
+static bool equalsNoCase(string_view text, string_view lower) {
+    return text.size() == lower.size() && startsWithNoCase(text, lower);
+}
+
+// Trim spaces and tabs
+static string_view trim(string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+// Accept-Encoding negotiation
+Encoding negotiateEncoding(string_view request) {
+    string_view headers = request.substr(0, request.find("\r\n\r\n"));
+    // Per coding: 0 = not listed, 1 = accepted, -1 = refused with q=0
+    int gzip = 0, deflate = 0, any = 0;
+
+    size_t pos = 0;
+    while ((pos = headers.find("\r\n", pos)) != string_view::npos) {
+        pos += 2;
+        string_view line = headers.substr(pos, headers.find("\r\n", pos) - pos);
+        if (!startsWithNoCase(line, "accept-encoding:")) continue;
+
+        string_view values = line.substr(16);
+        while (!values.empty()) {
+            size_t comma = values.find(',');
+            string_view item = values.substr(0, comma);
+            values = (comma == string_view::npos) ? string_view() : values.substr(comma + 1);
+
+            // "name;q=0" (or 0.0, 0.00...) means "not acceptable"
+            size_t semi = item.find(';');
+            string_view name = trim(item.substr(0, semi));
+            bool refused = false;
+            if (semi != string_view::npos) {
+                string_view params = trim(item.substr(semi + 1));
+                if (startsWithNoCase(params, "q=")) {
+                    string_view q = trim(params.substr(2));
+                    refused = !q.empty() && q.find_first_not_of("0.") == string_view::npos;
+                }
+            }
+            int state = refused ? -1 : 1;
+
+            if (equalsNoCase(name, "gzip") || equalsNoCase(name, "x-gzip")) gzip = state;
+            else if (equalsNoCase(name, "deflate")) deflate = state;
+            else if (name == "*") any = state;
+        }
+    }
+
+    // "*" covers only the codings not named explicitly
+    if (gzip == 1 || (gzip == 0 && any == 1)) return Encoding::Gzip;
+    if (deflate == 1 || (deflate == 0 && any == 1)) return Encoding::Deflate;
+    return Encoding::Identity;
+}
+
+const char* encodingName(Encoding encoding) {
+    switch (encoding) {
+        case Encoding::Gzip: return "gzip";
+        case Encoding::Deflate: return "deflate";
+        default: return "identity";
+    }
+}
@@ -0,0 +1,96 @@
+// Include guard
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+// Include C++ standard libraries
+#include <atomic>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Content encodings we can produce
+enum class Encoding { Identity, Gzip, Deflate };
+
+// Pick the best encoding listed in the request's Accept-Encoding header
+Encoding negotiateEncoding(std::string_view request);
+const char* encodingName(Encoding encoding);
+
+// Streaming gzip/deflate (zlib) compressor. Input is fed with write() in any
+// size of piece; compressed bytes are appended to out as each 64 KB block
+// fills, and finish() flushes the last block and the trailer. Its scratch
+// buffers come from out's memory resource.
+// Level 0 stores, 1-9 trade speed for ratio like zlib.
+class Compressor {
+public:
+    Compressor(Encoding encoding, int level, std::pmr::string& out);
+
+    void write(std::string_view data);
+    void finish();
+
+private:
+    void compressPending(bool last);
+    void emitStored(size_t start, size_t end, bool last);
+    void emitFixed(size_t start, size_t end, bool last);
+    void putBits(uint32_t value, int count);
+    void putCode(uint32_t code, int length);
+    void flushBits();
+
+    Encoding encoding_;
+    int maxChain_;
+    int niceLength_;
+    std::pmr::string& out_;
+
+    std::pmr::string window_; // up to 32 KB of history, then pending input
+    size_t base_ = 0;         // stream position of window_[0]
+    size_t pending_ = 0;      // offset in window_ of the first unencoded byte
+    std::pmr::vector<uint32_t> head_;
+    std::pmr::vector<uint32_t> prev_;
+
+    uint64_t bitBuf_ = 0;
+    int bitCount_ = 0;
+    uint32_t crc_ = 0;
+    uint32_t adlerA_ = 1, adlerB_ = 0;
+    uint64_t totalIn_ = 0;
+};
+
+// Response body after content negotiation
+struct EncodedBody {
+    std::pmr::string data;
+    Encoding encoding = Encoding::Identity;
+};
+
+// Response body built in pieces, in memory from `memory`. A body expected to
+// be under minBytes is passed through as is; otherwise each piece is
+// compressed as it arrives, so the whole uncompressed body is never held.
+class BodyEncoder {
+public:
+    BodyEncoder(Encoding encoding, int level, size_t expectedBytes, size_t minBytes,
+                std::pmr::memory_resource* memory);
+
+    BodyEncoder(const BodyEncoder&) = delete;
+    BodyEncoder& operator=(const BodyEncoder&) = delete;
+
+    void write(std::string_view data);
+    EncodedBody finish();
+
+private:
+    EncodedBody body_;
+    std::optional<Compressor> compressor_;
+    size_t rawBytes_ = 0;
+};
+
+// Bytes before and after encoding, reported on GET /stats
+struct CompressionStats {
+    std::atomic<unsigned long long> rawBytes{0};
+    std::atomic<unsigned long long> sentBytes{0};
+    std::atomic<unsigned long> compressed{0};
+    std::atomic<unsigned long> skipped{0};
+};
+
+const CompressionStats& compressionStats();
+
+// End include guard
+#endif
@@ -5,6 +5,12 @@
 #include <vector>
 #include <cstdlib>
 #include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <algorithm>
 using namespace oracle::occi;
 using namespace std;
 
@@ -25,11 +31,81 @@ const string user = getEnvVar("DB_USER", "system");
 const string pass = getEnvVar("DB_PASS", "Oracle@123");
 const string db   = getEnvVar("DB_HOST", "localhost:1521/orcl");
 
+// Shared environment and session pool, created on first use
+static mutex poolMutex;
+static Environment* poolEnv = nullptr;
+static StatelessConnectionPool* pool = nullptr;
+static size_t poolSessions = 0;
+
+static StatelessConnectionPool* sessionPool() {
+    lock_guard<mutex> lock(poolMutex);
+    if (!pool) {
+        if (!poolEnv) poolEnv = Environment::createEnvironment(Environment::THREADED_MUTEXED);
+        if (poolSessions == 0) poolSessions = dbPoolSize();
+        unsigned int size = static_cast<unsigned int>(poolSessions);
+        pool = poolEnv->createStatelessConnectionPool(user, pass, db, size, size, 1,
+                                                      StatelessConnectionPool::HOMOGENEOUS);
+    }
+    return pool;
+}
+
+// Session borrowed from the pool. Anything left uncommitted (an exception
+// mid-transaction) is rolled back before the session goes back, so no row
+// lock outlives the call.
+class PooledConnection {
+public:
+    PooledConnection() : pool_(sessionPool()), conn_(pool_->getConnection()) {}
+    ~PooledConnection() {
+        try {
+            conn_->rollback();
+        } catch (SQLException& e) {
+            cerr << "Rollback Error: " << e.getMessage() << endl;
+        }
+        pool_->releaseConnection(conn_);
+    }
+
+    PooledConnection(const PooledConnection&) = delete;
+    PooledConnection& operator=(const PooledConnection&) = delete;
+
+    Connection* operator->() const { return conn_; }
+
+private:
+    StatelessConnectionPool* pool_;
+    Connection* conn_;
+};
+
+// Statement on a pooled session. Its result set and cursor are released
+// however the call exits, so a failed call can't leak cursors on a session
+// that lives on in the pool (ORA-01000).
+class PooledStatement {
+public:
+    PooledStatement(const PooledConnection& conn, const string& sql)
+        : conn_(conn), stmt_(conn->createStatement(sql)) {}
+    ~PooledStatement() {
+        try {
+            if (rs_) stmt_->closeResultSet(rs_);
+            conn_->terminateStatement(stmt_);
+        } catch (SQLException& e) {
+            cerr << "Statement Cleanup Error: " << e.getMessage() << endl;
+        }
+    }
+
+    PooledStatement(const PooledStatement&) = delete;
+    PooledStatement& operator=(const PooledStatement&) = delete;
+
+    ResultSet* executeQuery() { return rs_ = stmt_->executeQuery(); }
+    Statement* operator->() const { return stmt_; }
+
+private:
+    const PooledConnection& conn_;
+    Statement* stmt_;
+    ResultSet* rs_ = nullptr;
+};
+
 // Table creation
 void createTables() {
     try {
-        Environment* env = Environment::createEnvironment();
-        Connection* conn = env->createConnection(user, pass, db);
+        PooledConnection conn;
 
         string sql = R"(
         BEGIN
@@ -39,7 +115,7 @@ void createTables() {
                 password VARCHAR2(100) NOT NULL
             )';
         EXCEPTION WHEN OTHERS THEN IF SQLCODE != -955 THEN RAISE; END IF; END;)";
-        conn->createStatement(sql)->execute();
+        PooledStatement(conn, sql)->execute();
 
         sql = R"(
         BEGIN
@@ -53,11 +129,29 @@ void createTables() {
                 FOREIGN KEY (user_id) REFERENCES users(id)
             )';
         EXCEPTION WHEN OTHERS THEN IF SQLCODE != -955 THEN RAISE; END IF; END;)";
-        conn->createStatement(sql)->execute();
+        PooledStatement(conn, sql)->execute();
+
+        // Migration: row version for patch conflict detection (-1430: column already exists)
+        sql = R"(
+        BEGIN
+            EXECUTE IMMEDIATE 'ALTER TABLE entries ADD (version NUMBER DEFAULT 1 NOT NULL)';
+        EXCEPTION WHEN OTHERS THEN IF SQLCODE != -1430 THEN RAISE; END IF; END;)";
+        PooledStatement(conn, sql)->execute();
+
+        // Migration: indexes for the per-user listings (-955: name exists, -1408: columns already indexed)
+        sql = R"(
+        BEGIN
+            EXECUTE IMMEDIATE 'CREATE INDEX entries_user_created_ix ON entries (user_id, created_at DESC, id)';
+        EXCEPTION WHEN OTHERS THEN IF SQLCODE NOT IN (-955, -1408) THEN RAISE; END IF; END;)";
+        PooledStatement(conn, sql)->execute();
+
+        sql = R"(
+        BEGIN
+            EXECUTE IMMEDIATE 'CREATE INDEX entries_user_date_ix ON entries (user_id, entry_date)';
+        EXCEPTION WHEN OTHERS THEN IF SQLCODE NOT IN (-955, -1408) THEN RAISE; END IF; END;)";
+        PooledStatement(conn, sql)->execute();
 
         conn->commit();
-        env->terminateConnection(conn);
-        Environment::terminateEnvironment(env);
 
         cout << "✅ Tables created or already exist.\n";
     } catch (SQLException& e) {
@@ -78,20 +172,16 @@ bool registerUser(const string& username, const string& password) {
     }
     
     try {
-        Environment* env = Environment::createEnvironment();
-        Connection* conn = env->createConnection(user, pass, db);
+        PooledConnection conn;
 
         string sql = "INSERT INTO users (username, password) VALUES (:1, :2)";
-        Statement* stmt = conn->createStatement(sql);
+        PooledStatement stmt(conn, sql);
         stmt->setString(1, username);
         stmt->setString(2, hashPassword(password));
 
         stmt->executeUpdate();
         conn->commit();
 
-        conn->terminateStatement(stmt);
-        env->terminateConnection(conn);
-        Environment::terminateEnvironment(env);
         return true;
     } catch (SQLException& e) {
         cerr << "Register Error: " << e.getMessage() << endl;
@@ -102,21 +192,16 @@ bool registerUser(const string& username, const string& password) {
 // Check if username exists
 bool usernameExists(const string& username) {
     try {
-        Environment* env = Environment::createEnvironment();
-        Connection* conn = env->createConnection(user, pass, db);
+        PooledConnection conn;
 
         string sql = "SELECT COUNT(*) FROM users WHERE username = :1";
-        Statement* stmt = conn->createStatement(sql);
+        PooledStatement stmt(conn, sql);
         stmt->setString(1, username);
         
-        ResultSet* rs = stmt->executeQuery();
+        ResultSet* rs = stmt.executeQuery();
         rs->next();
         int count = rs->getInt(1);
 
-        conn->terminateStatement(stmt);
-        env->terminateConnection(conn);
-        Environment::terminateEnvironment(env);
-        
         return count > 0;
     } catch (SQLException& e) {
         cerr << "Username check error: " << e.getMessage() << endl;
@@ -127,21 +212,16 @@ bool usernameExists(const string& username) {
 // Reset password
 bool resetPassword(const string& username, const string& newPassword) {
     try {
-        Environment* env = Environment::createEnvironment();
-        Connection* conn = env->createConnection(user, pass, db);
+        PooledConnection conn;
 
         string sql = "UPDATE users SET password = :1 WHERE username = :2";
-        Statement* stmt = conn->createStatement(sql);
+        PooledStatement stmt(conn, sql);
         stmt->setString(1, newPassword);
         stmt->setString(2, username);
 
         int rows = stmt->executeUpdate();
         conn->commit();
 
-        conn->terminateStatement(stmt);
-        env->terminateConnection(conn);
-        Environment::terminateEnvironment(env);
-        
         return rows > 0;
     } catch (SQLException& e) {
         cerr << "Reset password error: " << e.getMessage() << endl;
@@ -157,23 +237,17 @@ int loginUser(const string& username, const string& password) {
     
     int user_id = -1;
     try {
-        Environment* env = Environment::createEnvironment();
-        Connection* conn = env->createConnection(user, pass, db);
+        PooledConnection conn;
 
         string sql = "SELECT id FROM users WHERE username = :1 AND password = :2";
-        Statement* stmt = conn->createStatement(sql);
+        PooledStatement stmt(conn, sql);
         stmt->setString(1, username);
         stmt->setString(2, hashPassword(password));
 
-        ResultSet* rs = stmt->executeQuery();
+        ResultSet* rs = stmt.executeQuery();
         if (rs->next()) {
             user_id = rs->getInt(1);
         }
-
-        stmt->closeResultSet(rs);
-        conn->terminateStatement(stmt);
-        env->terminateConnection(conn);
-        Environment::terminateEnvironment(env);
     } catch (SQLException& e) {
         cerr << "Login Error: " << e.getMessage() << endl;
     }
@@ -188,12 +262,11 @@ bool insertEntry(int user_id, const string& title, const string& content, const
     }
     
     try {
-        Environment* env = Environment::createEnvironment();
-        Connection* conn = env->createConnection(user, pass, db);
+        PooledConnection conn;
 
         string sql = "INSERT INTO entries (user_id, title, content, entry_date) "
                      "VALUES (:1, :2, :3, TO_DATE(:4, 'YYYY-MM-DD'))";
-        Statement* stmt = conn->createStatement(sql);
+        PooledStatement stmt(conn, sql);
         stmt->setInt(1, user_id);
         stmt->setString(2, title);
         stmt->setString(3, content);
@@ -202,9 +275,6 @@ bool insertEntry(int user_id, const string& title, const string& content, const
         int result = stmt->executeUpdate();
         conn->commit();
 
-        conn->terminateStatement(stmt);
-        env->terminateConnection(conn);
-        Environment::terminateEnvironment(env);
         return result > 0;
     } catch (SQLException& e) {
         cerr << "Insert Entry Error: " << e.getMessage() << endl;
@@ -216,6 +286,7 @@ bool insertEntry(int user_id, const string& title, const string& content, const
 static string readClob(Clob& clob) {
     string content;
     if (!clob.isNull()) {
+        content.reserve(clob.length());
         Stream* instream = clob.getStream();
         char buffer[2048];
         int length;
@@ -227,88 +298,188 @@ static string readClob(Clob& clob) {
     return content;
 }
 
+// Map rows of (id, title, content, entry_date, created_at, version) to entries
+static vector<DiaryEntry> readEntries(ResultSet* rs) {
+    vector<DiaryEntry> entries;
+    while (rs->next()) {
+        DiaryEntry entry;
+        entry.id = rs->getInt(1);
+        entry.title = rs->getString(2);
+
+        Clob clob = rs->getClob(3);
+        entry.content = readClob(clob);
+
+        entry.entry_date = rs->getString(4);
+        entry.created_at = rs->getString(5);
+        entry.version = rs->getInt(6);
+        entries.push_back(move(entry));
+    }
+    return entries;
+}
+
 // Fetch diary entries
 vector<DiaryEntry> fetchEntries(int user_id) {
     vector<DiaryEntry> entries;
     try {
-        Environment* env = Environment::createEnvironment();
-        Connection* conn = env->createConnection(user, pass, db);
+        PooledConnection conn;
 
         string sql = "SELECT id, title, content, "
                      "TO_CHAR(entry_date, 'YYYY-MM-DD'), "
-                     "TO_CHAR(created_at, 'YYYY-MM-DD HH24:MI:SS') "
+                     "TO_CHAR(created_at, 'YYYY-MM-DD HH24:MI:SS'), version "
                      "FROM entries WHERE user_id = :1 ORDER BY created_at DESC";
-        Statement* stmt = conn->createStatement(sql);
+        PooledStatement stmt(conn, sql);
         stmt->setInt(1, user_id);
 
-        ResultSet* rs = stmt->executeQuery();
-        while (rs->next()) {
-            DiaryEntry entry;
-            entry.id = rs->getInt(1);
-            entry.title = rs->getString(2);
+        ResultSet* rs = stmt.executeQuery();
+        entries = readEntries(rs);
+    } catch (SQLException& e) {
+        cerr << "Fetch Entries Error: " << e.getMessage() << endl;
+    }
+    return entries;
+}
 
-            Clob clob = rs->getClob(3);
-            entry.content = readClob(clob);
+// Fetch diary entries with entry_date in [from, to] (YYYY-MM-DD, inclusive)
+vector<DiaryEntry> fetchEntriesByDate(int user_id, const string& from, const string& to) {
+    vector<DiaryEntry> entries;
+    try {
+        PooledConnection conn;
 
-            entry.entry_date = rs->getString(4);
-            entry.created_at = rs->getString(5);
-            entries.push_back(entry);
-        }
+        string sql = "SELECT id, title, content, "
+                     "TO_CHAR(entry_date, 'YYYY-MM-DD'), "
+                     "TO_CHAR(created_at, 'YYYY-MM-DD HH24:MI:SS'), version "
+                     "FROM entries WHERE user_id = :1 "
+                     "AND entry_date >= TO_DATE(:2, 'YYYY-MM-DD') "
+                     "AND entry_date < TO_DATE(:3, 'YYYY-MM-DD') + 1 "
+                     "ORDER BY entry_date DESC, created_at DESC";
+        PooledStatement stmt(conn, sql);
+        stmt->setInt(1, user_id);
+        stmt->setString(2, from);
+        stmt->setString(3, to);
 
-        stmt->closeResultSet(rs);
-        conn->terminateStatement(stmt);
-        env->terminateConnection(conn);
-        Environment::terminateEnvironment(env);
+        ResultSet* rs = stmt.executeQuery();
+        entries = readEntries(rs);
     } catch (SQLException& e) {
-        cerr << "Fetch Entries Error: " << e.getMessage() << endl;
+        cerr << "Fetch Entries By Date Error: " << e.getMessage() << endl;
     }
     return entries;
 }
 
-// Update diary entry
-bool updateEntry(int entry_id, const string& title, const string& content, const string& entry_date) {
+// Apply patch ops to text; false if an op falls outside it
+static bool applyPatchOps(string& text, const vector<PatchOp>& ops) {
+    for (const auto& op : ops) {
+        if (op.offset > text.size() || op.del > text.size() - op.offset) return false;
+        text.replace(op.offset, op.del, op.text);
+    }
+    return true;
+}
+
+// All 7-bit? (CLOB offsets and lengths are in characters, so byte offsets only match for ASCII)
+static bool isAscii(const string& text) {
+    for (unsigned char c : text) {
+        if (c >= 0x80) return false;
+    }
+    return true;
+}
+
+// Patch diary entry content in place
+PatchOutcome patchEntry(int entry_id, int user_id, int base_version, const vector<PatchOp>& ops,
+                        const string& title, const string& entry_date) {
+    PatchOutcome outcome;
     try {
-        Environment* env = Environment::createEnvironment();
-        Connection* conn = env->createConnection(user, pass, db);
+        PooledConnection conn;
 
-        string sql = "UPDATE entries SET title = :1, content = :2, "
-                     "entry_date = TO_DATE(:3, 'YYYY-MM-DD') WHERE id = :4";
-        Statement* stmt = conn->createStatement(sql);
-        stmt->setString(1, title);
-        stmt->setString(2, content);  // OCCI handles CLOB update as string
-        stmt->setString(3, entry_date);
-        stmt->setInt(4, entry_id);
+        // Lock the row so the version check and the write are atomic
+        string sql = "SELECT content, version FROM entries WHERE id = :1 AND user_id = :2 FOR UPDATE";
+        PooledStatement stmt(conn, sql);
+        stmt->setInt(1, entry_id);
+        stmt->setInt(2, user_id);
 
-        stmt->executeUpdate();
-        conn->commit();
+        ResultSet* rs = stmt.executeQuery();
+        if (!rs->next()) {
+            outcome.result = PatchResult::NotFound;
+        } else if (rs->getInt(2) != base_version) {
+            outcome.result = PatchResult::Conflict;
+            outcome.version = rs->getInt(2);
+        } else {
+            Clob clob = rs->getClob(1);
+            string current = readClob(clob);
+            string updated = current;
+
+            if (!applyPatchOps(updated, ops) || updated.empty() || updated.length() > 100000) {
+                outcome.result = PatchResult::Invalid;
+            } else {
+                // Unchanged prefix and suffix; only the bytes between them are rewritten
+                size_t start = 0;
+                size_t limit = min(current.size(), updated.size());
+                while (start < limit && current[start] == updated[start]) start++;
+                size_t suffix = 0;
+                if (current.size() == updated.size()) {
+                    while (suffix < limit - start && current[current.size() - 1 - suffix] == updated[updated.size() - 1 - suffix]) suffix++;
+                }
+
+                if (start == updated.size() && current.size() == updated.size()) {
+                    // Content unchanged (title/date-only edit)
+                } else if (!clob.isNull() && isAscii(current) && isAscii(updated)) {
+                    // Write from the first changed byte, then cut off any leftover tail
+                    size_t amount = updated.size() - start - suffix;
+                    clob.open(OCCI_LOB_READWRITE);
+                    if (amount > 0) {
+                        clob.write(static_cast<unsigned int>(amount),
+                                   reinterpret_cast<unsigned char*>(&updated[start]),
+                                   static_cast<unsigned int>(amount),
+                                   static_cast<unsigned int>(start + 1));
+                    }
+                    if (updated.size() < current.size()) {
+                        clob.trim(static_cast<unsigned int>(updated.size()));
+                    }
+                    clob.close();
+                } else {
+                    PooledStatement full(conn, "UPDATE entries SET content = :1 WHERE id = :2");
+                    full->setString(1, updated);
+                    full->setInt(2, entry_id);
+                    full->executeUpdate();
+                }
+
+                PooledStatement bump(conn,
+                    "UPDATE entries SET version = version + 1, "
+                    "title = :1, "
+                    "entry_date = NVL(TO_DATE(:2, 'YYYY-MM-DD'), entry_date) "
+                    "WHERE id = :3");
+                bump->setString(1, title);
+                bump->setString(2, entry_date);
+                bump->setInt(3, entry_id);
+                bump->executeUpdate();
+
+                outcome.result = PatchResult::Applied;
+                outcome.version = base_version + 1;
+            }
+        }
 
-        conn->terminateStatement(stmt);
-        env->terminateConnection(conn);
-        Environment::terminateEnvironment(env);
-        return true;
+        if (outcome.result == PatchResult::Applied) {
+            conn->commit();
+        } else {
+            conn->rollback();
+        }
     } catch (SQLException& e) {
-        cerr << "Update Entry Error: " << e.getMessage() << endl;
-        return false;
+        cerr << "Patch Entry Error: " << e.getMessage() << endl;
+        outcome.result = PatchResult::Error;
     }
+    return outcome;
 }
 
 // Delete diary entry
 bool deleteEntry(int entry_id, int user_id) {
     try {
-        Environment* env = Environment::createEnvironment();
-        Connection* conn = env->createConnection(user, pass, db);
+        PooledConnection conn;
 
         string sql = "DELETE FROM entries WHERE id = :1 AND user_id = :2";
-        Statement* stmt = conn->createStatement(sql);
+        PooledStatement stmt(conn, sql);
         stmt->setInt(1, entry_id);
         stmt->setInt(2, user_id);
 
         int rowsDeleted = stmt->executeUpdate();
         conn->commit();
 
-        conn->terminateStatement(stmt);
-        env->terminateConnection(conn);
-        Environment::terminateEnvironment(env);
         
         return rowsDeleted > 0;
     } catch (SQLException& e) {
@@ -321,39 +492,226 @@ bool deleteEntry(int entry_id, int user_id) {
 vector<DiaryEntry> searchEntries(int user_id, const string& keyword) {
     vector<DiaryEntry> results;
     try {
-        Environment* env = Environment::createEnvironment();
-        Connection* conn = env->createConnection(user, pass, db);
+        PooledConnection conn;
 
         string sql = "SELECT id, title, content, "
                      "TO_CHAR(entry_date, 'YYYY-MM-DD'), "
-                     "TO_CHAR(created_at, 'YYYY-MM-DD HH24:MI:SS') "
+                     "TO_CHAR(created_at, 'YYYY-MM-DD HH24:MI:SS'), version "
                      "FROM entries WHERE user_id = :1 AND "
                      "(LOWER(title) LIKE LOWER(:2) OR LOWER(content) LIKE LOWER(:2)) "
                      "ORDER BY created_at DESC";
-        Statement* stmt = conn->createStatement(sql);
+        PooledStatement stmt(conn, sql);
         stmt->setInt(1, user_id);
         stmt->setString(2, "%" + keyword + "%");
 
-        ResultSet* rs = stmt->executeQuery();
-        while (rs->next()) {
-            DiaryEntry entry;
-            entry.id = rs->getInt(1);
-            entry.title = rs->getString(2);
+        ResultSet* rs = stmt.executeQuery();
+        results = readEntries(rs);
+    } catch (SQLException& e) {
+        cerr << "Search Error: " << e.getMessage() << endl;
+    }
+    return results;
+}
+
+// A job and the continuation to run instead if it throws
+struct DbJob {
+    function<function<void()>()> run;
+    function<void()> failed;
+};
+
+// Worker threads sharing one set of priority queues
+struct WorkerGroup {
+    const char* name;
+    mutex jobMutex;
+    condition_variable jobReady;
+    deque<DbJob> jobs[3]; // indexed by DbPriority
+    vector<thread> workers;
+    bool stopping = false;
+    atomic<size_t> jobsInFlight{0};
+
+    // Any job queued?
+    bool hasJobs() const {
+        for (auto& q : jobs) {
+            if (!q.empty()) return true;
+        }
+        return false;
+    }
+};
+
+// Executor state: DB workers hold Oracle sessions, CPU workers encode responses
+static WorkerGroup dbGroup{"DB"};
+static WorkerGroup cpuGroup{"CPU"};
 
-            Clob clob = rs->getClob(3);
-            entry.content = readClob(clob);
+static mutex completionMutex;
+static deque<function<void()>> completions;
+static function<void()> completionHook;
+static atomic<bool> wakePending{false}; // hook already called since the last poll
+
+// Executor size, one thread per Oracle session we allow at once
+size_t dbPoolSize() {
+    int size = atoi(getEnvVar("DB_POOL_SIZE", "4").c_str());
+    return size > 0 ? static_cast<size_t>(size) : 4;
+}
 
-            entry.entry_date = rs->getString(4);
-            entry.created_at = rs->getString(5);
-            results.push_back(entry);
+// CPU pool size, one thread per core by default
+size_t cpuPoolSize() {
+    int size = atoi(getEnvVar("CPU_POOL_SIZE", "0").c_str());
+    if (size > 0) return static_cast<size_t>(size);
+    return max(1u, thread::hardware_concurrency());
+}
+
+// Worker loop
+static void worker(WorkerGroup& group) {
+    while (true) {
+        DbJob job;
+        {
+            unique_lock<mutex> lock(group.jobMutex);
+            group.jobReady.wait(lock, [&group] { return group.stopping || group.hasJobs(); });
+            if (!group.hasJobs()) return;
+            for (auto& q : group.jobs) {
+                if (q.empty()) continue;
+                job = move(q.front());
+                q.pop_front();
+                break;
+            }
+        }
+
+        function<void()> next;
+        try {
+            next = job.run();
+        } catch (exception& e) {
+            cerr << group.name << " Job Error: " << e.what() << endl;
+            next = job.failed;
+        } catch (...) {
+            cerr << group.name << " Job Error: unknown exception" << endl;
+            next = job.failed;
         }
+        group.jobsInFlight--;
+
+        if (next) {
+            {
+                lock_guard<mutex> lock(completionMutex);
+                completions.push_back(move(next));
+            }
+            if (completionHook && !wakePending.exchange(true)) completionHook();
+        }
+    }
+}
 
-        stmt->closeResultSet(rs);
-        conn->terminateStatement(stmt);
-        env->terminateConnection(conn);
-        Environment::terminateEnvironment(env);
+static void startWorkers(WorkerGroup& group, size_t threads) {
+    lock_guard<mutex> lock(group.jobMutex);
+    group.stopping = false;
+    for (size_t i = 0; i < threads; ++i) {
+        group.workers.emplace_back(worker, ref(group));
+    }
+}
+
+// Stop a group, letting queued jobs finish
+static void stopWorkers(WorkerGroup& group) {
+    {
+        lock_guard<mutex> lock(group.jobMutex);
+        group.stopping = true;
+    }
+    group.jobReady.notify_all();
+    for (auto& t : group.workers) t.join();
+    group.workers.clear();
+}
+
+static void submitJob(WorkerGroup& group, function<function<void()>()> job, function<void()> failed, DbPriority priority) {
+    group.jobsInFlight++;
+    {
+        lock_guard<mutex> lock(group.jobMutex);
+        group.jobs[static_cast<int>(priority)].push_back({move(job), move(failed)});
+    }
+    group.jobReady.notify_one();
+}
+
+// Start executor, with one pooled session per worker
+void startDbExecutor(size_t threads) {
+    {
+        lock_guard<mutex> lock(poolMutex);
+        poolSessions = threads;
+    }
+    try {
+        sessionPool();
     } catch (SQLException& e) {
-        cerr << "Search Error: " << e.getMessage() << endl;
+        cerr << "Session pool error (will retry on first use): " << e.getMessage() << endl;
     }
-    return results;
+    startWorkers(dbGroup, threads);
+}
+
+// Stop executor, letting queued jobs finish
+void stopDbExecutor() {
+    stopWorkers(dbGroup);
+
+    lock_guard<mutex> lock(poolMutex);
+    if (pool) poolEnv->terminateStatelessConnectionPool(pool);
+    if (poolEnv) Environment::terminateEnvironment(poolEnv);
+    pool = nullptr;
+    poolEnv = nullptr;
+}
+
+void startCpuExecutor(size_t threads) {
+    startWorkers(cpuGroup, threads);
+}
+
+void stopCpuExecutor() {
+    stopWorkers(cpuGroup);
+}
+
+// Queue a job
+void submitDbJob(function<function<void()>()> job, function<void()> failed, DbPriority priority) {
+    submitJob(dbGroup, move(job), move(failed), priority);
+}
+
+void submitCpuJob(function<function<void()>()> job, function<void()> failed) {
+    submitJob(cpuGroup, move(job), move(failed), DbPriority::Normal);
+}
+
+// Set the wake-up hook
+void setDbCompletionHook(function<void()> hook) {
+    completionHook = move(hook);
+}
+
+// Run finished continuations on the calling thread
+size_t pollDbCompletions() {
+    // Cleared before taking the queue, so a completion queued after this wakes us again
+    wakePending = false;
+    deque<function<void()>> ready;
+    {
+        lock_guard<mutex> lock(completionMutex);
+        ready.swap(completions);
+    }
+    for (auto& next : ready) next();
+    return ready.size();
+}
+
+// Jobs queued or running
+size_t dbJobsInFlight() {
+    return dbGroup.jobsInFlight;
+}
+
+size_t cpuJobsInFlight() {
+    return cpuGroup.jobsInFlight;
+}
+
+// Async wrappers
+void registerUserAsync(string username, string password, function<void(bool)> done, function<void()> failed) {
+    runDbAsync([username, password] { return registerUser(username, password); }, done, failed);
+}
+
+void loginUserAsync(string username, string password, function<void(int)> done, function<void()> failed) {
+    runDbAsync([username, password] { return loginUser(username, password); }, done, failed, DbPriority::High);
+}
+
+void insertEntryAsync(int user_id, string title, string content, string entry_date, function<void(bool)> done, function<void()> failed) {
+    runDbAsync([=] { return insertEntry(user_id, title, content, entry_date); }, done, failed);
+}
+
+void patchEntryAsync(int entry_id, int user_id, int base_version, vector<PatchOp> ops,
+                     string title, string entry_date, function<void(PatchOutcome)> done, function<void()> failed) {
+    runDbAsync([=] { return patchEntry(entry_id, user_id, base_version, ops, title, entry_date); }, done, failed);
+}
+
+void deleteEntryAsync(int entry_id, int user_id, function<void(bool)> done, function<void()> failed) {
+    runDbAsync([=] { return deleteEntry(entry_id, user_id); }, done, failed);
 }
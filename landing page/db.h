@@ -5,17 +5,43 @@
 // Include C++ standard libraries
 #include <string>
 #include <vector>
+#include <functional>
+#include <memory>
 
-// DiaryEntry struct
+// DiaryEntry struct (move-only, so a result set is never copied on its way to the response)
 struct DiaryEntry {
-    int id;
+    int id = 0;
     std::string title;
     std::string content;
     std::string entry_date;
     std::string created_at;
+    int version = 1;
+
+    DiaryEntry() = default;
+    DiaryEntry(DiaryEntry&&) = default;
+    DiaryEntry& operator=(DiaryEntry&&) = default;
+    DiaryEntry(const DiaryEntry&) = delete;
+    DiaryEntry& operator=(const DiaryEntry&) = delete;
+};
+
+// One content edit: delete `del` bytes at `offset`, then insert `text` there.
+// Ops apply in order, each against the result of the previous one.
+struct PatchOp {
+    size_t offset = 0;
+    size_t del = 0;
+    std::string text;
+};
+
+// Outcome of patchEntry()
+enum class PatchResult { Applied, Conflict, NotFound, Invalid, Error };
+
+struct PatchOutcome {
+    PatchResult result = PatchResult::Error;
+    int version = 0;
 };
 
 // Function declarations
+std::string getEnvVar(const std::string& key, const std::string& defaultValue);
 void createTables();
 bool registerUser(const std::string& username, const std::string& password);
 bool usernameExists(const std::string& username);
@@ -23,9 +49,70 @@ bool resetPassword(const std::string& username, const std::string& newPassword);
 int loginUser(const std::string& username, const std::string& password);
 bool insertEntry(int user_id, const std::string& title, const std::string& content, const std::string& entry_date);
 std::vector<DiaryEntry> fetchEntries(int user_id);
-bool updateEntry(int entry_id, const std::string& title, const std::string& content, const std::string& entry_date);
+std::vector<DiaryEntry> fetchEntriesByDate(int user_id, const std::string& from, const std::string& to);
+PatchOutcome patchEntry(int entry_id, int user_id, int base_version, const std::vector<PatchOp>& ops,
+                        const std::string& title, const std::string& entry_date);
 bool deleteEntry(int entry_id, int user_id);
 std::vector<DiaryEntry> searchEntries(int user_id, const std::string& keyword);
 
+// DB executor: a fixed set of threads that run OCCI calls off the I/O loop.
+// A job runs on a DB thread and returns a continuation; pollDbCompletions()
+// runs those continuations on the calling (I/O) thread. Each DB thread
+// borrows its Oracle session from a pool of the same size. Higher-priority
+// jobs are always taken first.
+enum class DbPriority { High = 0, Normal = 1, Low = 2 };
+
+size_t dbPoolSize();
+void startDbExecutor(size_t threads);
+void stopDbExecutor();
+void submitDbJob(std::function<std::function<void()>()> job, std::function<void()> failed,
+                 DbPriority priority = DbPriority::Normal);
+size_t pollDbCompletions();
+size_t dbJobsInFlight();
+
+// Called on a worker thread when a completion is queued while the I/O thread
+// may be asleep, so it can wake the loop that calls pollDbCompletions().
+// Set it before startDbExecutor().
+void setDbCompletionHook(std::function<void()> hook);
+
+// CPU pool: the same contract for work that needs no Oracle session
+// (building and compressing response bodies), so it never holds a DB thread.
+size_t cpuPoolSize();
+void startCpuExecutor(size_t threads);
+void stopCpuExecutor();
+void submitCpuJob(std::function<std::function<void()>()> job, std::function<void()> failed);
+size_t cpuJobsInFlight();
+
+// Job that runs work() and returns the continuation done(result)
+template <typename Work, typename Done>
+std::function<std::function<void()>()> continuationJob(Work work, Done done) {
+    return [work, done]() -> std::function<void()> {
+        // Shared so the continuation stays copyable for std::function
+        auto result = std::make_shared<decltype(work())>(work());
+        return [result, done]() { done(std::move(*result)); };
+    };
+}
+
+// Run work() on a DB thread, then done(result) on the I/O thread.
+// If work() throws, failed() runs on the I/O thread instead.
+template <typename Work, typename Done>
+void runDbAsync(Work work, Done done, std::function<void()> failed, DbPriority priority = DbPriority::Normal) {
+    submitDbJob(continuationJob(work, done), failed, priority);
+}
+
+// Same, on a CPU thread
+template <typename Work, typename Done>
+void runCpuAsync(Work work, Done done, std::function<void()> failed) {
+    submitCpuJob(continuationJob(work, done), failed);
+}
+
+// Async function declarations (callbacks run on the I/O thread; failed() if the call throws)
+void registerUserAsync(std::string username, std::string password, std::function<void(bool)> done, std::function<void()> failed);
+void loginUserAsync(std::string username, std::string password, std::function<void(int)> done, std::function<void()> failed);
+void insertEntryAsync(int user_id, std::string title, std::string content, std::string entry_date, std::function<void(bool)> done, std::function<void()> failed);
+void patchEntryAsync(int entry_id, int user_id, int base_version, std::vector<PatchOp> ops,
+                     std::string title, std::string entry_date, std::function<void(PatchOutcome)> done, std::function<void()> failed);
+void deleteEntryAsync(int entry_id, int user_id, std::function<void(bool)> done, std::function<void()> failed);
+
 // End include guard
 #endif
@@ -1,19 +1,91 @@
 // Includes and setup
+// select() watches every open connection; Winsock's fd_set holds only 64 sockets unless raised here
+#define FD_SETSIZE 4096
 #include <winsock2.h>
 #include <iostream>
 #include <fstream>
-#include <sstream>
 #include <string>
+#include <string_view>
+#include <charconv>
+#include <cstdio>
 #include <map>
 #include <random>
 #include <chrono>
+#include <vector>
+#include <algorithm>
 #include "db.h"
+#include "arena.h"
+#include "compress.h"
 
 #pragma comment(lib, "ws2_32.lib")
 using namespace std;
 
-// Session storage
-map<string, int> sessions;
+// Session storage (transparent comparator so lookups by string_view don't allocate)
+map<string, int, less<>> sessions;
+
+// Request arenas, reused across requests
+ArenaPool arenaPool;
+
+// Admission and connection limits, read once at startup
+struct Limits {
+    int backlog;
+    size_t acceptBatch;
+    size_t maxConnections;
+    size_t maxRequestBytes;
+    chrono::seconds readTimeout;
+    chrono::seconds sendTimeout;
+    size_t maxInflight;
+    size_t maxInflightExpensive;
+    double userRate, userBurst;
+    double ipRate, ipBurst;
+    int retryAfter;
+};
+
+Limits loadLimits() {
+    Limits l;
+    l.backlog = stoi(getEnvVar("LISTEN_BACKLOG", to_string(SOMAXCONN)));
+    l.acceptBatch = stoul(getEnvVar("ACCEPT_BATCH", "64"));
+    // Two fd_set slots go to the listener and the wake socket
+    l.maxConnections = min<size_t>(stoul(getEnvVar("MAX_CONNECTIONS", "4000")), FD_SETSIZE - 2);
+    l.maxRequestBytes = stoul(getEnvVar("MAX_REQUEST_BYTES", to_string(1024 * 1024)));
+    l.readTimeout = chrono::seconds(stoi(getEnvVar("REQUEST_TIMEOUT_SECS", "10")));
+    l.sendTimeout = chrono::seconds(stoi(getEnvVar("SEND_TIMEOUT_SECS", "60")));
+    l.maxInflight = stoul(getEnvVar("MAX_INFLIGHT", "256"));
+    l.maxInflightExpensive = stoul(getEnvVar("MAX_INFLIGHT_EXPENSIVE", to_string(l.maxInflight / 2)));
+    l.userRate = stod(getEnvVar("RATE_USER_PER_SEC", "10"));
+    l.userBurst = stod(getEnvVar("RATE_USER_BURST", "20"));
+    l.ipRate = stod(getEnvVar("RATE_IP_PER_SEC", "20"));
+    l.ipBurst = stod(getEnvVar("RATE_IP_BURST", "40"));
+    l.retryAfter = stoi(getEnvVar("RETRY_AFTER_SECS", "1"));
+    return l;
+}
+
+Limits limits;
+
+// Where a connection is in its request/response cycle
+enum class ConnState { Reading, Waiting, Writing, Done };
+
+// One client from accept() until its response is flushed. Sockets are
+// non-blocking; the request and the response both live in its arena. While
+// a CPU worker builds the response (Waiting), only that worker touches it.
+struct Connection {
+    Connection(SOCKET s, unsigned long addr, ArenaPool& pool)
+        : sock(s), ip(addr), arena(pool), in(arena.get()), head(arena.get()), body(arena.get()) {}
+
+    SOCKET sock;
+    unsigned long ip;
+    ArenaLease arena;
+    ArenaString in;           // request bytes received so far
+    size_t requestSize = 0;   // header + Content-Length, once the header is in
+    ArenaString head;         // response status line and headers
+    ArenaString body;         // response body
+    size_t sent = 0;          // bytes of head + body written
+    ConnState state = ConnState::Reading;
+    chrono::steady_clock::time_point deadline; // read the whole request, or next make write progress, by then
+};
+
+// Open connections by socket
+map<SOCKET, Connection> connections;
 
 // Generate session token
 string generateSessionToken() {
@@ -29,88 +101,202 @@ string generateSessionToken() {
 }
 
 // Get user ID from session
-int getSessionUserId(const string& request) {
+int getSessionUserId(string_view request) {
     size_t pos = request.find("Session-Token: ");
-    if (pos == string::npos) return -1;
+    if (pos == string_view::npos) return -1;
     
     pos += 15;
     size_t end = request.find("\r\n", pos);
-    if (end == string::npos) return -1;
+    if (end == string_view::npos) return -1;
     
-    string token = request.substr(pos, end - pos);
-    auto it = sessions.find(token);
+    auto it = sessions.find(request.substr(pos, end - pos));
     return (it != sessions.end()) ? it->second : -1;
 }
 
 // Read a file
-string readFile(const string& path) {
-    ifstream file(path, ios::in | ios::binary);
-    if (!file) return "<h1>File Not Found</h1>";
-    stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
-}
-
-// Receive full HTTP request
-string recvFullRequest(SOCKET client) {
-    string data;
-    char buf[65536];  // Increased to 64KB buffer
-    int n;
-
-    // Step 1: Read headers
-    while ((n = recv(client, buf, sizeof(buf), 0)) > 0) {
-        data.append(buf, n);
-        if (data.find("\r\n\r\n") != string::npos) break; // headers end
+ArenaString readFile(const char* path, Arena& arena) {
+    ArenaString content(&arena);
+    ifstream file(path, ios::in | ios::binary | ios::ate);
+    if (!file) {
+        content = "<h1>File Not Found</h1>";
+        return content;
     }
+    content.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(&content[0], content.size());
+    return content;
+}
+
+// Outcome of reading from a connection
+enum class ReadStatus { Partial, Complete, TooLarge, Closed };
+
+// Read whatever has arrived without blocking
+ReadStatus readRequest(Connection& c) {
+    char buf[65536];
+    while (true) {
+        int n = recv(c.sock, buf, sizeof(buf), 0);
+        if (n == SOCKET_ERROR) {
+            return WSAGetLastError() == WSAEWOULDBLOCK ? ReadStatus::Partial : ReadStatus::Closed;
+        }
+        if (n == 0) {
+            // Peer stopped sending; handle what we have, as before
+            if (c.in.empty()) return ReadStatus::Closed;
+            if (c.requestSize == 0) c.in += "\r\n\r\n";
+            return ReadStatus::Complete;
+        }
+
+        size_t searchFrom = c.in.size() < 3 ? 0 : c.in.size() - 3;
+        c.in.append(buf, n);
+
+        // Once the header is in, size the buffer for the body so it grows once
+        if (c.requestSize == 0) {
+            size_t header_end = c.in.find("\r\n\r\n", searchFrom);
+            if (header_end == string::npos) {
+                if (c.in.size() > limits.maxRequestBytes) return ReadStatus::TooLarge;
+                continue;
+            }
 
-    size_t header_end = data.find("\r\n\r\n");
-    string headers = (header_end != string::npos) ? data.substr(0, header_end) : data;
-
-    // Step 2: Extract Content-Length
-    size_t content_length = 0;
-    size_t cl_pos = headers.find("Content-Length:");
-    if (cl_pos != string::npos) {
-        cl_pos += 15; // skip "Content-Length:"
-        while (cl_pos < headers.size() && headers[cl_pos] == ' ') cl_pos++;
-        size_t line_end = headers.find("\r\n", cl_pos);
-        content_length = stoi(headers.substr(cl_pos, line_end - cl_pos));
+            string_view headers(c.in.data(), header_end);
+            size_t content_length = 0;
+            size_t cl_pos = headers.find("Content-Length:");
+            if (cl_pos != string_view::npos) {
+                cl_pos += 15; // skip "Content-Length:"
+                while (cl_pos < headers.size() && headers[cl_pos] == ' ') cl_pos++;
+                auto parsed = from_chars(headers.data() + cl_pos, headers.data() + headers.size(), content_length);
+                if (parsed.ec == errc::result_out_of_range) return ReadStatus::TooLarge;
+            }
+            if (content_length > limits.maxRequestBytes - min(limits.maxRequestBytes, header_end + 4)) {
+                return ReadStatus::TooLarge;
+            }
+            c.requestSize = header_end + 4 + content_length;
+            c.in.reserve(c.requestSize);
+        }
+        if (c.in.size() >= c.requestSize) return ReadStatus::Complete;
     }
+}
 
-    // Step 3: Read body until Content-Length
-    string body = (header_end != string::npos) ? data.substr(header_end + 4) : "";
-    while (body.size() < content_length) {
-        n = recv(client, buf, sizeof(buf), 0);
-        if (n <= 0) break;
-        body.append(buf, n);
+// Write as much of the response as the socket takes now; true once it is
+// all out, or the peer is gone
+bool flushResponse(Connection& c) {
+    size_t total = c.head.size() + c.body.size();
+    size_t before = c.sent;
+    while (c.sent < total) {
+        string_view part = c.sent < c.head.size() ? string_view(c.head).substr(c.sent)
+                                                   : string_view(c.body).substr(c.sent - c.head.size());
+        int n = send(c.sock, part.data(), static_cast<int>(min<size_t>(part.size(), 1 << 30)), 0);
+        if (n == SOCKET_ERROR) {
+            if (WSAGetLastError() != WSAEWOULDBLOCK) return true;
+            break;
+        }
+        c.sent += n;
     }
+    if (c.sent != before) c.deadline = chrono::steady_clock::now() + limits.sendTimeout;
+    return c.sent == total;
+}
+
+// Format the header for c.body and start writing; the main loop flushes the
+// rest and closes the connection
+void queueResponse(Connection& c, const char* status, const char* contentType, const char* extraHeaders) {
+    char header[512];
+    int len = snprintf(header, sizeof(header),
+                       "HTTP/1.1 %s\r\n"
+                       "Content-Type: %s\r\n"
+                       "Content-Length: %zu\r\n"
+                       "%s"
+                       "Connection: close\r\n\r\n",
+                       status, contentType, c.body.size(), extraHeaders);
+    c.head.assign(header, min<size_t>(len, sizeof(header) - 1));
+    c.sent = 0;
+    c.state = ConnState::Writing;
+    c.deadline = chrono::steady_clock::now() + limits.sendTimeout;
+    if (flushResponse(c)) c.state = ConnState::Done;
+}
+
+// Send HTTP response; the body is copied into the connection's arena
+void sendResponse(SOCKET client, string_view content, const char* status = "200 OK", const char* contentType = "text/html", const char* extraHeaders = "") {
+    auto it = connections.find(client);
+    if (it == connections.end()) return;
+    it->second.body.assign(content.data(), content.size());
+    queueResponse(it->second, status, contentType, extraHeaders);
+}
+
+// Same, for a body already built in the connection's arena (taken over, not copied)
+void sendBody(SOCKET client, ArenaString&& content, const char* status = "200 OK", const char* contentType = "text/html", const char* extraHeaders = "") {
+    auto it = connections.find(client);
+    if (it == connections.end()) return;
+    it->second.body = move(content);
+    queueResponse(it->second, status, contentType, extraHeaders);
+}
+
+// Parse a decimal ID
+bool parseId(string_view text, int& id) {
+    auto result = from_chars(text.data(), text.data() + text.size(), id);
+    return result.ec == errc() && result.ptr == text.data() + text.size() && id > 0;
+}
 
-    return headers + "\r\n\r\n" + body;
+// Parse patch ops: "<offset>:<delete>:<insertLength>:<text>" repeated, lengths in bytes
+bool parsePatchOps(string_view text, vector<PatchOp>& ops) {
+    while (!text.empty()) {
+        size_t fields[3];
+        for (size_t& field : fields) {
+            auto result = from_chars(text.data(), text.data() + text.size(), field);
+            if (result.ec != errc() || result.ptr == text.data() + text.size() || *result.ptr != ':') return false;
+            text.remove_prefix(result.ptr - text.data() + 1);
+        }
+        if (fields[2] > text.size()) return false;
+
+        PatchOp op;
+        op.offset = fields[0];
+        op.del = fields[1];
+        op.text.assign(text.data(), fields[2]);
+        ops.push_back(move(op));
+        text.remove_prefix(fields[2]);
+    }
+    return true;
 }
 
-// Send HTTP response
-void sendResponse(SOCKET client, const string& content, const string& status = "200 OK", const string& contentType = "text/html") {
-    string response = "HTTP/1.1 " + status + "\r\n"
-                      "Content-Type: " + contentType + "\r\n"
-                      "Content-Length: " + to_string(content.length()) + "\r\n"
-                      "Connection: close\r\n\r\n" + content;
-    send(client, response.c_str(), response.size(), 0);
+// Check a YYYY-MM-DD date is a real calendar day in years 0001-9999
+bool validateDate(string_view date) {
+    if (date.length() != 10 || date[4] != '-' || date[7] != '-') return false;
+    for (size_t i = 0; i < date.length(); ++i) {
+        if (i != 4 && i != 7 && (date[i] < '0' || date[i] > '9')) return false;
+    }
+    auto number = [date](size_t pos, size_t len) {
+        int value = 0;
+        for (size_t i = pos; i < pos + len; ++i) value = value * 10 + (date[i] - '0');
+        return value;
+    };
+    int year = number(0, 4), month = number(5, 2), day = number(8, 2);
+    if (year < 1 || month < 1 || month > 12 || day < 1) return false;
+
+    static const int monthDays[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    return day <= monthDays[month - 1] + (month == 2 && leap ? 1 : 0);
 }
 
 // Extract URL-encoded form data
-string extract(const string& key, const string& body) {
-    size_t pos = body.find(key + "=");
-    if (pos == string::npos) return "";
+ArenaString extract(string_view key, string_view body, Arena& arena) {
+    ArenaString decoded(&arena);
+
+    // Match "key=" only at the start of a field
+    size_t pos = body.find(key);
+    while (pos != string_view::npos &&
+           ((pos > 0 && body[pos - 1] != '&') || pos + key.length() >= body.length() || body[pos + key.length()] != '=')) {
+        pos = body.find(key, pos + 1);
+    }
+    if (pos == string_view::npos) return decoded;
     pos += key.length() + 1;
-    size_t end = body.find("&", pos);
-    if (end == string::npos) end = body.length();
+    size_t end = body.find('&', pos);
+    if (end == string_view::npos) end = body.length();
     
-    string value = body.substr(pos, end - pos);
+    string_view value = body.substr(pos, end - pos);
 
     // URL decode
-    string decoded;
+    decoded.reserve(value.length());
     for (size_t i = 0; i < value.length(); ++i) {
-        if (value[i] == '%' && i + 2 < value.length()) {
-            int hex = stoi(value.substr(i + 1, 2), nullptr, 16);
+        int hex = 0;
+        if (value[i] == '%' && i + 2 < value.length() &&
+            from_chars(value.data() + i + 1, value.data() + i + 3, hex, 16).ptr == value.data() + i + 3) {
             decoded += static_cast<char>(hex);
             i += 2;
         } else if (value[i] == '+') {
@@ -122,285 +308,681 @@ string extract(const string& key, const string& body) {
     return decoded;
 }
 
+// Extract a query-string parameter from the request line
+ArenaString queryParam(string_view key, string_view req, Arena& arena) {
+    string_view line = req.substr(0, req.find("\r\n"));
+    size_t start = line.find('?');
+    if (start == string_view::npos) return ArenaString(&arena);
+    string_view query = line.substr(start + 1);
+    return extract(key, query.substr(0, query.find(' ')), arena);
+}
+
+// Append input to output, replacing characters that have an escape
+template <typename Escape>
+void appendEscaped(string_view input, ArenaString& output, Escape escape) {
+    size_t start = 0;
+    for (size_t i = 0; i < input.size(); ++i) {
+        const char* replacement = escape(input[i]);
+        if (replacement) {
+            output.append(input.data() + start, i - start);
+            output += replacement;
+            start = i + 1;
+        }
+    }
+    output.append(input.data() + start, input.size() - start);
+}
+
 // Escape HTML
-string escapeHtml(const string& input) {
-    string output;
-    for (char c : input) {
+void escapeHtml(string_view input, ArenaString& output) {
+    appendEscaped(input, output, [](char c) -> const char* {
         switch (c) {
-            case '<': output += "&lt;"; break;
-            case '>': output += "&gt;"; break;
-            case '&': output += "&amp;"; break;
-            case '"': output += "&quot;"; break;
-            case '\'': output += "&#x27;"; break;
-            default: output += c;
+            case '<': return "&lt;";
+            case '>': return "&gt;";
+            case '&': return "&amp;";
+            case '"': return "&quot;";
+            case '\'': return "&#x27;";
+            default: return nullptr;
         }
-    }
-    return output;
+    });
 }
 
 // Validate input
-bool validateInput(const string& input, size_t maxLength = 1000) {
+bool validateInput(string_view input, size_t maxLength = 1000) {
     return !input.empty() && input.length() <= maxLength;
 }
 
 // Escape JSON
-string escapeJson(const string& input) {
-    string output;
-    for (char c : input) {
+void escapeJson(string_view input, ArenaString& output) {
+    appendEscaped(input, output, [](char c) -> const char* {
         switch (c) {
-            case '"': output += "\\\""; break;
-            case '\\': output += "\\\\"; break;
-            case '\b': output += "\\b"; break;
-            case '\f': output += "\\f"; break;
-            case '\n': output += "\\n"; break;
-            case '\r': output += "\\r"; break;
-            case '\t': output += "\\t"; break;
-            default: output += c;
+            case '"': return "\\\"";
+            case '\\': return "\\\\";
+            case '\b': return "\\b";
+            case '\f': return "\\f";
+            case '\n': return "\\n";
+            case '\r': return "\\r";
+            case '\t': return "\\t";
+            default: return nullptr;
         }
+    });
+}
+
+// Expected JSON size for entries: the raw text plus field names and some escaping
+size_t entriesJsonSize(const vector<DiaryEntry>& entries) {
+    size_t estimate = 2;
+    for (const auto& e : entries) {
+        estimate += 96 + e.title.size() + e.content.size() + e.entry_date.size() + e.created_at.size();
     }
-    return output;
+    return estimate + estimate / 8;
+}
+
+// Append one entry as a JSON object
+void appendEntryJson(const DiaryEntry& e, ArenaString& json) {
+    char id[16];
+    json += "{\"id\":";
+    json.append(id, to_chars(id, id + sizeof(id), e.id).ptr - id);
+    json += ",\"title\":\"";
+    escapeJson(e.title, json);
+    json += "\",\"content\":\"";
+    escapeJson(e.content, json);
+    json += "\",\"entry_date\":\"";
+    escapeJson(e.entry_date, json);
+    json += "\",\"created_at\":\"";
+    escapeJson(e.created_at, json);
+    json += "\",\"version\":";
+    json.append(id, to_chars(id, id + sizeof(id), e.version).ptr - id);
+    json += "}";
 }
 
-// Build JSON for entries
-string buildEntriesJson(const vector<DiaryEntry>& entries) {
-    string json = "[";
+// Response compression settings, read once at startup
+struct CompressionConfig {
+    size_t minBytes;
+    int levelView;
+    int levelSearch;
+    int levelExport;
+};
+
+CompressionConfig loadCompressionConfig() {
+    CompressionConfig c;
+    c.minBytes = stoul(getEnvVar("COMPRESS_MIN_BYTES", "1024"));
+    c.levelView = stoi(getEnvVar("COMPRESS_LEVEL_VIEW", "6"));
+    c.levelSearch = stoi(getEnvVar("COMPRESS_LEVEL_SEARCH", "6"));
+    c.levelExport = stoi(getEnvVar("COMPRESS_LEVEL_EXPORT", "6"));
+    return c;
+}
+
+CompressionConfig compression;
+
+// Build and encode an entries response in the connection's arena; runs on a
+// CPU worker, so compression holds up neither socket I/O nor a DB session.
+// Entries are encoded one at a time, so only the compressed body is kept whole.
+EncodedBody encodeEntries(const vector<DiaryEntry>& entries, Encoding encoding, int level, Arena& arena) {
+    BodyEncoder body(encoding, level, entriesJsonSize(entries), compression.minBytes, &arena);
+    ArenaString json(&arena);
+    body.write("[");
     for (size_t i = 0; i < entries.size(); ++i) {
-        const auto& e = entries[i];
-        json += "{";
-        json += "\"id\":" + to_string(e.id) + ",";
-        json += "\"title\":\"" + escapeJson(e.title) + "\",";
-        json += "\"content\":\"" + escapeJson(e.content) + "\",";
-        json += "\"entry_date\":\"" + escapeJson(e.entry_date) + "\",";
-        json += "\"created_at\":\"" + escapeJson(e.created_at) + "\"";
-        json += "}";
-        if (i != entries.size() - 1) json += ",";
+        json.clear();
+        if (i != 0) json += ",";
+        appendEntryJson(entries[i], json);
+        body.write(json);
     }
-    json += "]";
-    return json;
+    body.write("]");
+    return body.finish();
 }
 
-// Main server setup
-int main() {
-    createTables();
+// Send a negotiated body built in the connection's arena
+void sendEncoded(SOCKET client, EncodedBody&& body, const char* contentType) {
+    char headers[96];
+    if (body.encoding == Encoding::Identity) {
+        snprintf(headers, sizeof(headers), "Vary: Accept-Encoding\r\n");
+    } else {
+        snprintf(headers, sizeof(headers), "Content-Encoding: %s\r\nVary: Accept-Encoding\r\n", encodingName(body.encoding));
+    }
+    sendBody(client, move(body.data), "200 OK", contentType, headers);
+}
 
-    WSADATA wsa;
-    SOCKET server, client;
-    struct sockaddr_in server_addr{}, client_addr{};
-    int client_len = sizeof(client_addr);
+// Continuation for a DB job that threw: answer 500
+function<void()> failWith500(SOCKET client) {
+    return [client] {
+        sendResponse(client, "Internal server error", "500 Internal Server Error");
+    };
+}
 
-    WSAStartup(MAKEWORD(2, 2), &wsa);
-    server = socket(AF_INET, SOCK_STREAM, 0);
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(8080);
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    bind(server, (struct sockaddr*)&server_addr, sizeof(server_addr));
-    listen(server, 3);
+// Encode rows fetched by a DB job on the CPU pool, then send them
+void sendEntriesAsync(SOCKET client, vector<DiaryEntry> entries, Encoding encoding, int level) {
+    auto it = connections.find(client);
+    if (it == connections.end()) return;
+    Arena* arena = it->second.arena.get();
+    auto rows = make_shared<vector<DiaryEntry>>(move(entries)); // the job must be copyable
+    runCpuAsync([rows, encoding, level, arena] {
+        return encodeEntries(*rows, encoding, level, *arena);
+    }, [client](EncodedBody body) {
+        sendEncoded(client, move(body), "application/json");
+    }, failWith500(client));
+}
 
-    cout << "Server running at http://localhost:8080\n";
+// Shed-request counters, exposed on GET /stats
+struct ShedStats {
+    unsigned long served = 0;
+    unsigned long overload = 0;
+    unsigned long userRate = 0;
+    unsigned long ipRate = 0;
+};
+
+ShedStats shedStats;
+
+// Token bucket
+struct TokenBucket {
+    double tokens;
+    chrono::steady_clock::time_point last;
+};
+
+// Buckets by key, plus when idle ones were last swept out
+template <typename Key>
+struct BucketTable {
+    map<Key, TokenBucket> buckets;
+    chrono::steady_clock::time_point lastSweep;
+};
+
+BucketTable<int> userBuckets;
+BucketTable<unsigned long> ipBuckets;
+
+// Take one token from the bucket for key, refilling by elapsed time
+template <typename Key>
+bool takeToken(BucketTable<Key>& table, const Key& key, double rate, double burst) {
+    auto now = chrono::steady_clock::now();
+    auto& buckets = table.buckets;
+
+    // Forget idle buckets at most every 10 s once the table is large;
+    // a full bucket is the same as a new one
+    if (buckets.size() > 10000 && now - table.lastSweep > chrono::seconds(10)) {
+        table.lastSweep = now;
+        for (auto it = buckets.begin(); it != buckets.end();) {
+            double idle = chrono::duration<double>(now - it->second.last).count();
+            it = (it->second.tokens + idle * rate >= burst) ? buckets.erase(it) : next(it);
+        }
+    }
 
-    while ((client = accept(server, (struct sockaddr*)&client_addr, &client_len)) != INVALID_SOCKET) {
-        
-        string req = recvFullRequest(client); // ✅ full request read
+    auto it = buckets.find(key);
+    if (it == buckets.end()) {
+        it = buckets.emplace(key, TokenBucket{burst, now}).first;
+    }
 
-        // Handle requests
-        if (req.find("GET / ") != string::npos || req.find("GET /index.html") != string::npos) {
-            sendResponse(client, readFile("public/index.html"));
+    TokenBucket& b = it->second;
+    double elapsed = chrono::duration<double>(now - b.last).count();
+    b.tokens = min(burst, b.tokens + elapsed * rate);
+    b.last = now;
 
-        } else if (req.find("GET /style.css") != string::npos) {
-            sendResponse(client, readFile("public/style.css"), "200 OK", "text/css");
+    if (b.tokens < 1.0) return false;
+    b.tokens -= 1.0;
+    return true;
+}
 
-        } else if (req.find("GET /script.js") != string::npos) {
-            sendResponse(client, readFile("public/script.js"), "200 OK", "application/javascript");
+// Send a 503/429 with Retry-After
+void sendRetryLater(SOCKET client, const char* status, string_view content) {
+    char retryAfter[48];
+    snprintf(retryAfter, sizeof(retryAfter), "Retry-After: %d\r\n", limits.retryAfter);
+    sendResponse(client, content, status, "text/plain", retryAfter);
+}
 
-        } else if (req.find("GET /Diary.png") != string::npos) {
-            sendResponse(client, readFile("public/Diary.png"), "200 OK", "image/png");
+// Resolve the session and apply the per-user limit; sends 401/429 on failure
+int authorizeRequest(SOCKET client, string_view req) {
+    int user_id = getSessionUserId(req);
+    if (user_id <= 0) {
+        sendResponse(client, "Unauthorized", "401 Unauthorized");
+        return -1;
+    }
+    if (!takeToken(userBuckets, user_id, limits.userRate, limits.userBurst)) {
+        shedStats.userRate++;
+        sendRetryLater(client, "429 Too Many Requests", "Rate limit exceeded");
+        return -1;
+    }
+    shedStats.served++;
+    return user_id;
+}
 
-        } else if (req.find("GET /diary_background.jpg") != string::npos) {
-            sendResponse(client, readFile("public/diary_background.jpg"), "200 OK", "image/jpeg");
+// Does the request line start with prefix? (method + path; all dispatch goes through this)
+bool routeIs(string_view req, string_view prefix) {
+    return req.compare(0, prefix.size(), prefix) == 0;
+}
 
-        } else if (req.find("POST /login") != string::npos) {
-            size_t pos = req.find("\r\n\r\n");
-            string body = req.substr(pos + 4);
-            string uname = extract("username", body);
-            string pwd = extract("password", body);
+// Route cost classes, served in this order within an accept batch
+enum RouteClass { ROUTE_CHEAP = 0, ROUTE_DB = 1, ROUTE_EXPENSIVE = 2 };
 
-            if (!validateInput(uname, 50) || !validateInput(pwd, 100)) {
-                sendResponse(client, "INVALID_INPUT");
-                closesocket(client);
-                continue;
-            }
+RouteClass classifyRoute(string_view req) {
+    if (routeIs(req, "GET /entry/export") || routeIs(req, "GET /entry/search?")) {
+        return ROUTE_EXPENSIVE;
+    }
+    if (routeIs(req, "POST ") || routeIs(req, "GET /entry/")) {
+        return ROUTE_DB;
+    }
+    return ROUTE_CHEAP;
+}
+
+// Build JSON for shed counters
+string buildStatsJson() {
+    const CompressionStats& cs = compressionStats();
+    unsigned long long raw = cs.rawBytes, sent = cs.sentBytes;
+    return "{\"served\":" + to_string(shedStats.served) +
+           ",\"shed_overload\":" + to_string(shedStats.overload) +
+           ",\"shed_user_rate\":" + to_string(shedStats.userRate) +
+           ",\"shed_ip_rate\":" + to_string(shedStats.ipRate) +
+           ",\"db_inflight\":" + to_string(dbJobsInFlight()) +
+           ",\"cpu_inflight\":" + to_string(cpuJobsInFlight()) +
+           ",\"arena_requests\":" + to_string(arenaStats().requests.load()) +
+           ",\"arena_chunk_allocs\":" + to_string(arenaStats().chunkAllocs.load()) +
+           ",\"arena_peak_bytes\":" + to_string(arenaStats().peakBytes.load()) +
+           ",\"compress_responses\":" + to_string(cs.compressed.load()) +
+           ",\"compress_skipped\":" + to_string(cs.skipped.load()) +
+           ",\"compress_raw_bytes\":" + to_string(raw) +
+           ",\"compress_sent_bytes\":" + to_string(sent) +
+           ",\"compress_saved_ratio\":" + to_string(raw ? 1.0 - double(sent) / double(raw) : 0.0) +
+           (heapAllocCountEnabled()
+                ? ",\"heap_allocs_per_request\":" + to_string(heapAllocCount() / max(1ul, shedStats.served))
+                : string()) + "}";
+}
+
+// Handle one request; returns true if a DB completion will send the response
+bool handleRequest(SOCKET client, string_view req, Arena& arena) {
+    // /entry/ routes count as served once authorizeRequest() lets them through
+    if (!routeIs(req, "GET /entry/") && !routeIs(req, "POST /entry/")) shedStats.served++;
 
-            int uid = loginUser(uname, pwd);
+    if (routeIs(req, "GET / ") || routeIs(req, "GET /index.html")) {
+        sendBody(client, readFile("public/index.html", arena));
+
+    } else if (routeIs(req, "GET /style.css")) {
+        sendBody(client, readFile("public/style.css", arena), "200 OK", "text/css");
+
+    } else if (routeIs(req, "GET /script.js")) {
+        sendBody(client, readFile("public/script.js", arena), "200 OK", "application/javascript");
+
+    } else if (routeIs(req, "GET /Diary.png")) {
+        sendBody(client, readFile("public/Diary.png", arena), "200 OK", "image/png");
+
+    } else if (routeIs(req, "GET /diary_background.jpg")) {
+        sendBody(client, readFile("public/diary_background.jpg", arena), "200 OK", "image/jpeg");
+
+    } else if (routeIs(req, "GET /stats")) {
+        sendResponse(client, buildStatsJson(), "200 OK", "application/json");
+
+    } else if (routeIs(req, "POST /login")) {
+        string_view body = req.substr(req.find("\r\n\r\n") + 4);
+        ArenaString uname = extract("username", body, arena);
+        ArenaString pwd = extract("password", body, arena);
+
+        if (!validateInput(uname, 50) || !validateInput(pwd, 100)) {
+            sendResponse(client, "INVALID_INPUT");
+            return false;
+        }
+
+        loginUserAsync(string(uname), string(pwd), [client](int uid) {
             if (uid > 0) {
                 string token = generateSessionToken();
                 sessions[token] = uid;
-                string response = "HTTP/1.1 200 OK\r\n"
-                                "Content-Type: text/plain\r\n"
-                                "Session-Token: " + token + "\r\n"
-                                "Content-Length: 13\r\n"
-                                "Connection: close\r\n\r\nLOGIN_SUCCESS";
-                send(client, response.c_str(), response.size(), 0);
+                string header = "Session-Token: " + token + "\r\n";
+                sendResponse(client, "LOGIN_SUCCESS", "200 OK", "text/plain", header.c_str());
             } else {
                 sendResponse(client, "LOGIN_FAILED");
             }
+        }, failWith500(client));
+        return true;
 
-        } else if (req.find("POST /register") != string::npos) {
-            size_t pos = req.find("\r\n\r\n");
-            string body = req.substr(pos + 4);
-            string uname = extract("username", body);
-            string pwd = extract("password", body);
+    } else if (routeIs(req, "POST /register")) {
+        string_view body = req.substr(req.find("\r\n\r\n") + 4);
+        ArenaString uname = extract("username", body, arena);
+        ArenaString pwd = extract("password", body, arena);
 
-            if (!validateInput(uname, 50) || !validateInput(pwd, 100)) {
-                sendResponse(client, "INVALID_INPUT");
-                closesocket(client);
-                continue;
-            }
+        if (!validateInput(uname, 50) || !validateInput(pwd, 100)) {
+            sendResponse(client, "INVALID_INPUT");
+            return false;
+        }
 
-            bool registered = registerUser(uname, pwd);
+        registerUserAsync(string(uname), string(pwd), [client](bool registered) {
             if (registered) {
                 sendResponse(client, "REGISTER_SUCCESS");
             } else {
                 sendResponse(client, "REGISTER_FAILED");
             }
+        }, failWith500(client));
+        return true;
+
+    } else if (routeIs(req, "GET /logout")) {
+        size_t pos = req.find("Session-Token: ");
+        if (pos != string_view::npos) {
+            pos += 15;
+            size_t end = req.find("\r\n", pos);
+            auto it = sessions.find(req.substr(pos, end - pos));
+            if (it != sessions.end()) sessions.erase(it);
+        }
+        sendResponse(client, "Logged out");
 
-        } else if (req.find("GET /logout") != string::npos) {
-            string token;
-            size_t pos = req.find("Session-Token: ");
-            if (pos != string::npos) {
-                pos += 15;
-                size_t end = req.find("\r\n", pos);
-                token = req.substr(pos, end - pos);
-                sessions.erase(token);
-            }
-            sendResponse(client, "Logged out");
-
-        } else if (req.find("POST /entry/create") != string::npos) {
-            int user_id = getSessionUserId(req);
-            if (user_id <= 0) {
-                sendResponse(client, "Unauthorized", "401 Unauthorized");
-                closesocket(client);
-                continue;
-            }
+    } else if (routeIs(req, "POST /entry/create")) {
+        int user_id = authorizeRequest(client, req);
+        if (user_id <= 0) return false;
 
-            size_t pos = req.find("\r\n\r\n");
-            string body = req.substr(pos + 4);
-            string title = extract("title", body);
-            string content = extract("content", body);
-            string entry_date = extract("entry_date", body);
+        string_view body = req.substr(req.find("\r\n\r\n") + 4);
+        ArenaString title = extract("title", body, arena);
+        ArenaString content = extract("content", body, arena);
+        ArenaString entry_date = extract("entry_date", body, arena);
 
-            if (!validateInput(title, 200) || !validateInput(content, 100000)) {
-                sendResponse(client, "Invalid input", "400 Bad Request");
-                closesocket(client);
-                continue;
-            }
+        if (!validateInput(title, 200) || !validateInput(content, 100000) ||
+            (!entry_date.empty() && !validateDate(entry_date))) {
+            sendResponse(client, "Invalid input", "400 Bad Request");
+            return false;
+        }
 
-            bool success = insertEntry(user_id, title, content, entry_date);
+        insertEntryAsync(user_id, string(title), string(content), string(entry_date), [client](bool success) {
             if (success) {
                 sendResponse(client, "Entry created");
             } else {
                 sendResponse(client, "Failed to create entry", "500 Internal Server Error");
             }
+        }, failWith500(client));
+        return true;
+
+    } else if (routeIs(req, "GET /entry/view")) {
+        int user_id = authorizeRequest(client, req);
+        if (user_id <= 0) return false;
+
+        // Optional date range, either end may be left open
+        ArenaString from = queryParam("from", req, arena);
+        ArenaString to = queryParam("to", req, arena);
+        // The query adds a day to "to", so the last DATE Oracle can hold is out of range
+        if ((!from.empty() && !validateDate(from)) ||
+            (!to.empty() && (!validateDate(to) || to > "9999-12-30"))) {
+            sendResponse(client, "Invalid date range", "400 Bad Request");
+            return false;
+        }
+        bool byDate = !from.empty() || !to.empty();
+        if (from.empty()) from = "0001-01-01";
+        if (to.empty()) to = "9999-12-30";
+
+        Encoding encoding = negotiateEncoding(req);
+        runDbAsync([user_id, byDate, from = string(from), to = string(to)] {
+            return byDate ? fetchEntriesByDate(user_id, from, to) : fetchEntries(user_id);
+        }, [client, encoding](vector<DiaryEntry> entries) {
+            sendEntriesAsync(client, move(entries), encoding, compression.levelView);
+        }, failWith500(client));
+        return true;
+
+    } else if (routeIs(req, "POST /entry/patch")) {
+        int user_id = authorizeRequest(client, req);
+        if (user_id <= 0) return false;
+
+        string_view body = req.substr(req.find("\r\n\r\n") + 4);
+        int id = 0, base_version = 0;
+        vector<PatchOp> ops;
+        if (!parseId(extract("id", body, arena), id) ||
+            !parseId(extract("base_version", body, arena), base_version) ||
+            !parsePatchOps(extract("ops", body, arena), ops)) {
+            sendResponse(client, "Invalid patch", "400 Bad Request");
+            return false;
+        }
+        ArenaString title = extract("title", body, arena);
+        ArenaString entry_date = extract("entry_date", body, arena);
+        if (!validateInput(title, 200) || (!entry_date.empty() && !validateDate(entry_date))) {
+            sendResponse(client, "Invalid input", "400 Bad Request");
+            return false;
+        }
 
-        } else if (req.find("GET /entry/view") != string::npos) {
-            int user_id = getSessionUserId(req);
-            if (user_id <= 0) {
-                sendResponse(client, "Unauthorized", "401 Unauthorized");
-                closesocket(client);
-                continue;
+        patchEntryAsync(id, user_id, base_version, move(ops), string(title), string(entry_date), [client](PatchOutcome outcome) {
+            char header[48];
+            snprintf(header, sizeof(header), "Entry-Version: %d\r\n", outcome.version);
+            switch (outcome.result) {
+                case PatchResult::Applied: sendResponse(client, "Entry updated", "200 OK", "text/html", header); break;
+                case PatchResult::Conflict: sendResponse(client, "Entry was changed elsewhere", "409 Conflict", "text/html", header); break;
+                case PatchResult::NotFound: sendResponse(client, "Entry not found", "404 Not Found"); break;
+                case PatchResult::Invalid: sendResponse(client, "Patch does not apply", "422 Unprocessable Entity"); break;
+                default: sendResponse(client, "Failed to update entry", "500 Internal Server Error");
             }
+        }, failWith500(client));
+        return true;
 
-            vector<DiaryEntry> entries = fetchEntries(user_id);
-            string json = buildEntriesJson(entries);
-            sendResponse(client, json, "200 OK", "application/json");
+    } else if (routeIs(req, "GET /entry/delete?")) {
+        int user_id = authorizeRequest(client, req);
+        if (user_id <= 0) return false;
 
-        } else if (req.find("POST /entry/edit") != string::npos) {
-            int user_id = getSessionUserId(req);
-            if (user_id <= 0) {
-                sendResponse(client, "Unauthorized", "401 Unauthorized");
-                closesocket(client);
-                continue;
-            }
-            size_t pos = req.find( "\r\n\r\n" ); 
-        string body = req.substr(pos + 4);
-        int id = stoi(extract("id", body));
-        string title = extract("title", body);
-        string content = extract("content", body);
-        string entry_date = extract("entry_date", body);
-        if (updateEntry(id, title, content, entry_date)) {
-            sendResponse(client, "Entry updated");
+        ArenaString idStr = queryParam("id", req, arena);
+        int id = 0;
+        if (idStr.empty()) {
+            sendResponse(client, "Missing entry ID", "400 Bad Request");
+        } else if (!parseId(idStr, id)) {
+            sendResponse(client, "Invalid entry ID", "400 Bad Request");
         } else {
-            sendResponse(client, "Failed to update entry", "500 Internal Server Error");
+            deleteEntryAsync(id, user_id, [client](bool deleted) {
+                if (deleted) {
+                    sendResponse(client, "Entry deleted");
+                } else {
+                    sendResponse(client, "Failed to delete entry", "500 Internal Server Error");
+                }
+            }, failWith500(client));
+            return true;
         }
 
-    } else if (req.find("GET /entry/delete?") != string::npos) {
-        int user_id = getSessionUserId(req);
-        if (user_id <= 0) {
-            sendResponse(client, "Unauthorized", "401 Unauthorized");
-            closesocket(client);
-            continue;
+    } else if (routeIs(req, "GET /entry/search?")) {
+        int user_id = authorizeRequest(client, req);
+        if (user_id <= 0) return false;
+
+        ArenaString keyword = queryParam("q", req, arena);
+        if (validateInput(keyword, 100)) {
+            Encoding encoding = negotiateEncoding(req);
+            runDbAsync([user_id, keyword = string(keyword)] {
+                return searchEntries(user_id, keyword);
+            }, [client, encoding](vector<DiaryEntry> entries) {
+                sendEntriesAsync(client, move(entries), encoding, compression.levelSearch);
+            }, failWith500(client), DbPriority::Low);
+            return true;
+        } else {
+            sendResponse(client, "Invalid search query", "400 Bad Request");
         }
 
-        size_t pos = req.find("id=");
-        if (pos != string::npos) {
-            pos += 3; // Skip "id="
-            size_t end = req.find(" ", pos); // Find end of ID (space before HTTP/1.1)
-            if (end == string::npos) end = req.find("&", pos);
-            if (end == string::npos) end = req.find("\r", pos);
-            
-            string idStr = req.substr(pos, end - pos);
-            int id = stoi(idStr);
-            
-            if (deleteEntry(id, user_id)) {
-                sendResponse(client, "Entry deleted");
-            } else {
-                sendResponse(client, "Failed to delete entry", "500 Internal Server Error");
+    } else if (routeIs(req, "GET /entry/export")) {
+        int user_id = authorizeRequest(client, req);
+        if (user_id <= 0) return false;
+
+        Encoding encoding = negotiateEncoding(req);
+        runDbAsync([user_id] {
+            return fetchEntries(user_id);
+        }, [client, encoding](vector<DiaryEntry> entries) {
+            sendEntriesAsync(client, move(entries), encoding, compression.levelExport);
+        }, failWith500(client), DbPriority::Low);
+        return true;
+
+    } else {
+        sendResponse(client, "<h1>404 Not Found</h1>", "404 Not Found");
+    }
+
+    return false;
+}
+
+// Request read in full, waiting to be dispatched; its text lives in the connection
+struct IncomingRequest {
+    SOCKET client;
+    RouteClass route;
+};
+
+// Read from a connection; a complete request joins `ready`
+void readFrom(Connection& c, vector<IncomingRequest>& ready) {
+    switch (readRequest(c)) {
+        case ReadStatus::Partial:
+            break;
+        case ReadStatus::Complete:
+            c.state = ConnState::Waiting;
+            ready.push_back({c.sock, classifyRoute(c.in)});
+            break;
+        case ReadStatus::TooLarge:
+            sendResponse(c.sock, "Request too large", "413 Payload Too Large");
+            break;
+        case ReadStatus::Closed:
+            c.state = ConnState::Done;
+            break;
+    }
+}
+
+// Loopback UDP socket the DB workers poke when a completion is queued
+SOCKET wakeSocket = INVALID_SOCKET;
+
+SOCKET openWakeSocket() {
+    SOCKET s = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int len = sizeof(addr);
+    bind(s, (struct sockaddr*)&addr, sizeof(addr));
+    getsockname(s, (struct sockaddr*)&addr, &len);
+    connect(s, (struct sockaddr*)&addr, sizeof(addr));
+    unsigned long nonBlocking = 1;
+    ioctlsocket(s, FIONBIO, &nonBlocking);
+    return s;
+}
+
+// Main server setup
+int main() {
+    limits = loadLimits();
+    compression = loadCompressionConfig();
+
+    WSADATA wsa;
+    SOCKET server, client;
+    struct sockaddr_in server_addr{}, client_addr{};
+    int client_len = sizeof(client_addr);
+
+    WSAStartup(MAKEWORD(2, 2), &wsa);
+
+    // Finished DB work wakes select() straight away instead of waiting out its timeout
+    wakeSocket = openWakeSocket();
+    setDbCompletionHook([] {
+        char wake = 0;
+        send(wakeSocket, &wake, 1, 0);
+    });
+
+    startDbExecutor(dbPoolSize());
+    startCpuExecutor(cpuPoolSize());
+    createTables();
+
+    server = socket(AF_INET, SOCK_STREAM, 0);
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(8080);
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    bind(server, (struct sockaddr*)&server_addr, sizeof(server_addr));
+    listen(server, limits.backlog);
+    unsigned long nonBlocking = 1;
+    ioctlsocket(server, FIONBIO, &nonBlocking);
+
+    cout << "Server running at http://localhost:8080\n";
+
+    vector<IncomingRequest> batch;
+    batch.reserve(limits.acceptBatch);
+    bool running = true;
+    while (running) {
+        // Resume handlers whose DB work has finished; their responses start writing here
+        pollDbCompletions();
+
+        // Close finished and timed-out connections, and watch the rest.
+        // Connections waiting on the DB have no deadline: their job will answer.
+        fd_set readSet, writeSet;
+        FD_ZERO(&readSet);
+        FD_ZERO(&writeSet);
+        FD_SET(wakeSocket, &readSet);
+        SOCKET maxSocket = wakeSocket;
+        if (connections.size() < limits.maxConnections) {
+            FD_SET(server, &readSet);
+            maxSocket = max(maxSocket, server);
+        }
+        auto now = chrono::steady_clock::now();
+        for (auto it = connections.begin(); it != connections.end();) {
+            Connection& c = it->second;
+            if (now > c.deadline) {
+                if (c.state == ConnState::Reading) {
+                    sendResponse(c.sock, "Request timeout", "408 Request Timeout");
+                } else if (c.state == ConnState::Writing) {
+                    c.state = ConnState::Done;
+                }
             }
-        } else {
-            sendResponse(client, "Missing entry ID", "400 Bad Request");
+            if (c.state == ConnState::Done) {
+                closesocket(c.sock);
+                it = connections.erase(it);
+                continue;
+            }
+            if (c.state == ConnState::Reading) FD_SET(c.sock, &readSet);
+            if (c.state == ConnState::Writing) FD_SET(c.sock, &writeSet);
+            maxSocket = max(maxSocket, c.sock);
+            ++it;
         }
 
-    } else if (req.find("GET /entry/search?") != string::npos) {
-        int user_id = getSessionUserId(req);
-        if (user_id <= 0) {
-            sendResponse(client, "Unauthorized", "401 Unauthorized");
-            closesocket(client);
-            continue;
+        // Sleep until a socket is ready or a worker wakes us; the timeout only paces deadline checks
+        timeval timeout{1, 0};
+        int ready = select(static_cast<int>(maxSocket) + 1, &readSet, &writeSet, nullptr, &timeout);
+        if (ready == SOCKET_ERROR) break;
+        if (FD_ISSET(wakeSocket, &readSet)) {
+            char drain[64];
+            while (recv(wakeSocket, drain, sizeof(drain), 0) > 0) {}
         }
 
-        size_t pos = req.find("q=");
-        if (pos != string::npos) {
-            string keyword = req.substr(pos + 2);
-            if (validateInput(keyword, 100)) {
-                vector<DiaryEntry> results = searchEntries(user_id, keyword);
-                string json = buildEntriesJson(results);
-                sendResponse(client, json, "200 OK", "application/json");
-            } else {
-                sendResponse(client, "Invalid search query", "400 Bad Request");
+        // Flush responses and read requests on the sockets that are ready
+        batch.clear();
+        for (auto& [sock, c] : connections) {
+            if (c.state == ConnState::Writing && FD_ISSET(sock, &writeSet)) {
+                if (flushResponse(c)) c.state = ConnState::Done;
+            } else if (c.state == ConnState::Reading && FD_ISSET(sock, &readSet)) {
+                readFrom(c, batch);
             }
         }
 
-    } else if (req.find("GET /entry/export") != string::npos) {
-        int user_id = getSessionUserId(req);
-        if (user_id <= 0) {
-            sendResponse(client, "Unauthorized", "401 Unauthorized");
-            closesocket(client);
-            continue;
+        // Take new connections, up to one batch per pass
+        if (FD_ISSET(server, &readSet)) {
+            for (size_t i = 0; i < limits.acceptBatch && connections.size() < limits.maxConnections; ++i) {
+                client_len = sizeof(client_addr);
+                client = accept(server, (struct sockaddr*)&client_addr, &client_len);
+                if (client == INVALID_SOCKET) break; // queue drained
+
+                ioctlsocket(client, FIONBIO, &nonBlocking);
+                // Header and body go out as separate sends; don't let Nagle hold the body back
+                int noDelay = 1;
+                setsockopt(client, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+
+                Connection& c = connections.try_emplace(client, client, static_cast<unsigned long>(client_addr.sin_addr.s_addr), arenaPool).first->second;
+                c.deadline = chrono::steady_clock::now() + limits.readTimeout;
+                readFrom(c, batch); // the request has usually arrived with the connection
+            }
         }
 
-        vector<DiaryEntry> entries = fetchEntries(user_id);
-        string json = buildEntriesJson(entries);
-        sendResponse(client, json, "200 OK", "application/json");
-
-    } else {
-        sendResponse(client, "<h1>404 Not Found</h1>", "404 Not Found");
+        // Cheap routes first, expensive last (one pass per class keeps arrival order)
+        for (int cls = ROUTE_CHEAP; cls <= ROUTE_EXPENSIVE; ++cls) {
+            for (auto& in : batch) {
+                if (in.route != cls) continue;
+                Connection& conn = connections.at(in.client);
+
+                if (in.route != ROUTE_CHEAP) {
+                    // Shed before doing any work when the DB queue is full
+                    size_t cap = (in.route == ROUTE_EXPENSIVE) ? limits.maxInflightExpensive : limits.maxInflight;
+                    if (dbJobsInFlight() + cpuJobsInFlight() >= cap) {
+                        shedStats.overload++;
+                        sendRetryLater(in.client, "503 Service Unavailable", "Server busy");
+                        continue;
+                    }
+                    if (!takeToken(ipBuckets, conn.ip, limits.ipRate, limits.ipBurst)) {
+                        shedStats.ipRate++;
+                        sendRetryLater(in.client, "429 Too Many Requests", "Rate limit exceeded");
+                        continue;
+                    }
+                }
+
+                handleRequest(in.client, conn.in, *conn.arena); // responds now, or from a DB completion
+            }
+        }
     }
 
-    closesocket(client);
-}
-
-// Close server
-closesocket(server);
-WSACleanup();
-return 0;
+    // Finish in-flight DB work, then the encoding it hands on, before shutting down
+    stopDbExecutor();
+    pollDbCompletions();
+    stopCpuExecutor();
+    pollDbCompletions();
+    for (auto& entry : connections) closesocket(entry.first);
+    connections.clear();
+
+    // Close server
+    closesocket(server);
+    closesocket(wakeSocket);
+    WSACleanup();
+    return 0;
 }
-
@@ -1,5 +1,6 @@
 // Variables
 let currentEntryId = null;
+let currentEntry = null;
 let entries = [];
 let sessionToken = null;
 
@@ -170,6 +171,7 @@ async function handleLogout() {
     document.getElementById('login-form').reset();
     entries = [];
     currentEntryId = null;
+    currentEntry = null;
 }
 
 function checkAutoLogin() {
@@ -261,6 +263,7 @@ function renderEntries(entriesToRender) {
 // Create entry
 function createNewEntry() {
     currentEntryId = null;
+    currentEntry = null;
     document.getElementById('editor-title').textContent = 'New Entry';
     document.getElementById('entry-title').value = '';
     document.getElementById('entry-content').value = '';
@@ -272,6 +275,7 @@ function createNewEntry() {
 // Edit entry
 function editEntry(entry) {
     currentEntryId = entry.id;
+    currentEntry = entry;
     document.getElementById('editor-title').textContent = 'Edit Entry';
     document.getElementById('entry-title').value = decodeURIComponent(entry.title);
     document.getElementById('entry-content').value = decodeURIComponent(entry.content);
@@ -286,6 +290,29 @@ function showEditor() {
     entryEditor.classList.remove('hidden');
 }
 
+// Build a patch turning oldText into newText as one replace op:
+// "<offset>:<delete>:<insertLength>:<text>", offsets and lengths in UTF-8 bytes
+function buildContentPatch(oldText, newText) {
+    const a = new TextEncoder().encode(oldText);
+    const b = new TextEncoder().encode(newText);
+    const isCont = byte => (byte & 0xC0) === 0x80;
+
+    let start = 0;
+    const max = Math.min(a.length, b.length);
+    while (start < max && a[start] === b[start]) start++;
+    let end = 0;
+    while (end < max - start && a[a.length - 1 - end] === b[b.length - 1 - end]) end++;
+
+    // Keep both cut points on character boundaries
+    while (start > 0 && ((start < a.length && isCont(a[start])) || (start < b.length && isCont(b[start])))) start--;
+    while (end > 0 && (isCont(a[a.length - end]) || isCont(b[b.length - end]))) end--;
+
+    const deleted = a.length - end - start;
+    const inserted = b.subarray(start, b.length - end);
+    if (deleted === 0 && inserted.length === 0) return '';
+    return `${start}:${deleted}:${inserted.length}:${new TextDecoder().decode(inserted)}`;
+}
+
 // Save entries
 async function saveEntry() {
     const saveBtn = document.getElementById('save-btn');
@@ -304,9 +331,10 @@ async function saveEntry() {
             return;
         }
         
-        const url = currentEntryId ? '/entry/edit' : '/entry/create';
+        // Existing entries send only what changed, against the version we loaded
+        const url = currentEntryId ? '/entry/patch' : '/entry/create';
         const body = currentEntryId 
-            ? `id=${currentEntryId}&title=${encodeURIComponent(title)}&content=${encodeURIComponent(content)}&entry_date=${entryDate}`
+            ? `id=${currentEntryId}&base_version=${currentEntry.version}&title=${encodeURIComponent(title)}&ops=${encodeURIComponent(buildContentPatch(currentEntry.content, content))}&entry_date=${entryDate}`
             : `title=${encodeURIComponent(title)}&content=${encodeURIComponent(content)}&entry_date=${entryDate}`;
         
         const response = await fetch(url, {
@@ -322,9 +350,27 @@ async function saveEntry() {
         console.log('Save response:', response.status, responseText);
         
         if (response.ok) {
+            // Later saves from this editor patch against what we just stored
+            if (currentEntry) {
+                currentEntry.version = Number(response.headers.get('Entry-Version')) || currentEntry.version + 1;
+                currentEntry.content = content;
+            }
             document.getElementById('last-saved').textContent = `Last saved: ${new Date().toLocaleTimeString()}`;
             await loadEntries();
             alert('✅ Entry saved successfully!');
+        } else if (response.status === 409) {
+            // Never drop the user's text: rebase onto the stored copy and let them choose
+            await loadEntries();
+            const latest = entries.find(e => e.id === currentEntryId);
+            if (!latest) {
+                alert('❌ Save failed: This entry was deleted elsewhere. Copy your text before leaving the editor.');
+            } else if (confirm('This entry was changed elsewhere.\n\n' +
+                               'OK: keep your text in the editor, then review it and save again (this replaces the other changes).\n' +
+                               'Cancel: discard your changes and load the latest version.')) {
+                currentEntry = latest;
+            } else {
+                editEntry(latest);
+            }
         } else if (response.status === 401 || responseText.includes('Unauthorized')) {
             alert('❌ Save failed: Your session has expired. Please log in again.');
             handleUnauthorized();